@@ -11,6 +11,35 @@ GroupDeleteCallbacks group_delete_callbacks;
 
 LoadGroupsCallbacks load_groups_callbacks;
 
+void DispatchEvent(const SetParentEvent& e)
+{
+    set_parent_callbacks.invoke(e.pluginID, e.childName, e.parentName);
+}
+
+void DispatchEvent(const SetOptionGroupEvent& e)
+{
+    set_option_group_callbacks.invoke(e.pluginID, e.groupName, e.optionName, e.value);
+}
+
+void DispatchEvent(const GroupPermissionEvent& e)
+{
+    group_permission_callbacks.invoke(e.pluginID, e.action, e.groupName, e.perm, e.oldState, e.newState);
+}
+
+void DispatchEvent(const GroupCreateEvent& e)
+{
+    group_create_callbacks.invoke(e.pluginID, e.name, e.perms, e.priority, e.parent);
+}
+
+void DispatchEvent(const GroupDeleteEvent& e)
+{
+    {
+        DepartedGroupScope departed(XXH3_64bits(e.name.data(), e.name.size()), e.group);
+        group_delete_callbacks.invoke(e.pluginID, e.name);
+    }
+    g_Epoch.retire(e.group); // users read without locks may still walk old versions which hold it
+}
+
 PLUGIFY_WARN_PUSH()
 
 #if defined(__clang__)
@@ -44,11 +73,9 @@ extern "C" PLUGIN_API Status SetParent(const int64_t pluginID, const plg::string
         return Status::ParentGroupNotFound;
 
     it1->second->_parent = empty_group ? nullptr : it2->second;
-    {
-        std::shared_lock lock2(set_parent_callbacks._lock);
-        for (const SetParentCallback cb : set_parent_callbacks._callbacks)
-            cb(pluginID, childName, parentName);
-    }
+    RefreshGroups();
+    RefreshUsers();
+    g_EventQueue.push(SetParentEvent{pluginID, childName, parentName});
     return Status::Success;
 }
 
@@ -63,13 +90,13 @@ extern "C" PLUGIN_API Status GetParent(const plg::string& groupName, plg::string
 {
     const uint64_t hash = XXH3_64bits(groupName.data(), groupName.size());
     std::shared_lock lock(groups_mtx);
-    const auto it = groups.find(hash);
+    const Group* group = ViewGroupByHash(hash);
 
-    if (it == groups.end())
+    if (group == nullptr)
         return Status::ChildGroupNotFound;
-    if (!it->second->_parent)
+    if (!group->_parent)
         return Status::ParentGroupNotFound;
-    parentName = it->second->_parent->_name;
+    parentName = group->_parent.load()->_name;
     return Status::Success;
 }
 
@@ -84,11 +111,11 @@ extern "C" PLUGIN_API Status DumpPermissionsGroup(const plg::string& name, plg::
 {
     const uint64_t hash = XXH3_64bits(name.data(), name.size());
     std::shared_lock lock(groups_mtx);
-    const auto v = groups.find(hash);
-    if (v == groups.end())
+    const Group* group = ViewGroupByHash(hash);
+    if (group == nullptr)
         return Status::ChildGroupNotFound;
 
-    perms = Node::dumpNode(v->second->_nodes);
+    perms = group->current().nodes.dump();
 
     return Status::Success;
 }
@@ -124,12 +151,12 @@ extern "C" PLUGIN_API Status HasPermissionGroupExtended(const plg::string& name,
 		return Status::Error;
     const uint64_t hash = XXH3_64bits(name.data(), name.size());
     std::shared_lock lock(groups_mtx);
-    const auto it = groups.find(hash);
-    if (it == groups.end())
+    const Group* group = ViewGroupByHash(hash);
+    if (group == nullptr)
         return Status::GroupNotFound;
 
     bool w_wildcard;
-    Status status = it->second->hasPermission(perm, exact, w_wildcard);
+    Status status = group->current().hasPermission(perm, exact, w_wildcard);
     if (exact && isWildcard(perm) != w_wildcard)
         return Status::PermNotFound;
     return status;
@@ -147,6 +174,32 @@ extern "C" PLUGIN_API Status HasPermissionGroup(const plg::string& name, const p
     return HasPermissionGroupExtended(name, perm, false);
 }
 
+/**
+ * @brief Check if a group has a registered permission.
+ *
+ * @param name Group name.
+ * @param handle Permission handle returned by RegisterPermission.
+ * @return Allow, Disallow, PermNotFound, GroupNotFound, Error
+ */
+extern "C" PLUGIN_API Status HasPermissionGroupByHandle(const plg::string& name, const uint32_t handle)
+{
+    const RegisteredPerm* rp = g_PermRegistry.get(handle);
+    if (rp == nullptr)
+        return Status::Error;
+    const uint64_t hash = XXH3_64bits(name.data(), name.size());
+    std::shared_lock lock(groups_mtx);
+    const Group* group = ViewGroupByHash(hash);
+    if (group == nullptr)
+        return Status::GroupNotFound;
+
+    const GroupVersion& version = group->current();
+    if (version.bits.contains(handle))
+        return version.bits.test(handle);
+
+    bool w_wildcard;
+    return version._hasPermission(rp->ids.data(), static_cast<int>(rp->ids.size()), false, w_wildcard);
+}
+
 /**
  * @brief Check if parent_name is a parent group for child_name.
  *
@@ -159,15 +212,13 @@ extern "C" PLUGIN_API Status HasParentGroup(const plg::string& childName, const
     const uint64_t hash1 = XXH3_64bits(childName.data(), childName.size());
     const uint64_t hash2 = XXH3_64bits(parentName.data(), parentName.size());
     std::shared_lock lock(groups_mtx);
-    const auto it1 = groups.find(hash1);
-    const auto it2 = groups.find(hash2);
-    if (it1 == groups.end())
+    const Group* g1 = ViewGroupByHash(hash1);
+    const Group* g2 = ViewGroupByHash(hash2);
+    if (g1 == nullptr)
         return Status::ChildGroupNotFound;
-    if (it2 == groups.end())
+    if (g2 == nullptr)
         return Status::ParentGroupNotFound;
 
-    const Group* g1 = it1->second;
-    const Group* g2 = it2->second;
     while (g1)
     {
         if (g1->_parent == g2) return Status::Allow;
@@ -187,10 +238,10 @@ extern "C" PLUGIN_API Status GetPriorityGroup(const plg::string& groupName, int&
 {
     const uint64_t hash = XXH3_64bits(groupName.data(), groupName.size());
     std::shared_lock lock(groups_mtx);
-    const auto it = groups.find(hash);
-    if (it == groups.end())
+    const Group* group = ViewGroupByHash(hash);
+    if (group == nullptr)
         return Status::GroupNotFound;
-    priority = it->second->_priority;
+    priority = group->_priority;
     return Status::Success;
 }
 
@@ -216,7 +267,7 @@ extern "C" PLUGIN_API Status AddPermissionGroup(const int64_t pluginID, const pl
 
     const bool denied = perm.starts_with('-');
     bool w_wildcard;
-    const Status oldState = it->second->hasPermission(perm, true, w_wildcard);
+    const Status oldState = it->second->current().hasPermission(perm, true, w_wildcard);
     const bool diff = !((denied && oldState == Status::Disallow) || (!denied && oldState == Status::Allow));
 
 	bool replaceToWC = false;
@@ -247,14 +298,14 @@ extern "C" PLUGIN_API Status AddPermissionGroup(const int64_t pluginID, const pl
 			act = Action::ReplaceToWC;
 		const plg::string prm = denied ? perm.substr(1) : perm;
 		{
-			std::unique_lock lock2(users_mtx); // Need to eliminate race in user->group permissions check
-			it->second->_nodes.addPerm(perm);
-		}
-		{
-			std::shared_lock lock3(group_permission_callbacks._lock);
-			for (const GroupPermissionCallback cb : group_permission_callbacks._callbacks)
-				cb(pluginID, act, name, perm, oldState, denied ? Status::Disallow : Status::Allow);
+			GroupVersion* version = it->second->edit();
+			version->nodes.addPerm(perm);
+			it->second->publish(version);
+			RefreshGroups();
+			RefreshUsers();
 		}
+		g_EventQueue.push(GroupPermissionEvent{pluginID, act, name, perm, oldState,
+		                                       denied ? Status::Disallow : Status::Allow});
 	}
     return Status::Success;
 }
@@ -272,7 +323,7 @@ extern "C" PLUGIN_API Status SetPermissionGroup(const int64_t pluginID, const pl
 
 	const bool denied = perm.starts_with('-');
 	bool w_wildcard;
-	const Status oldState = it->second->hasPermission(perm, true, w_wildcard);
+	const Status oldState = it->second->current().hasPermission(perm, true, w_wildcard);
 	bool diff = !((denied && oldState == Status::Disallow) || (!denied && oldState == Status::Allow));
 
 	bool replaceToWC = false;
@@ -300,14 +351,14 @@ extern "C" PLUGIN_API Status SetPermissionGroup(const int64_t pluginID, const pl
 			act = Action::ReplaceToWC;
 		const plg::string prm = denied ? perm.substr(1) : perm;
 		{
-			std::unique_lock lock2(users_mtx); // Need to eliminate race in user->group permissions check
-			it->second->_nodes.addPerm(perm);
-		}
-		{
-			std::shared_lock lock3(group_permission_callbacks._lock);
-			for (const GroupPermissionCallback cb : group_permission_callbacks._callbacks)
-				cb(pluginID, act, name, perm, oldState, denied ? Status::Disallow : Status::Allow);
+			GroupVersion* version = it->second->edit();
+			version->nodes.addPerm(perm);
+			it->second->publish(version);
+			RefreshGroups();
+			RefreshUsers();
 		}
+		g_EventQueue.push(GroupPermissionEvent{pluginID, act, name, perm, oldState,
+		                                       denied ? Status::Disallow : Status::Allow});
 	}
 
 	return Status::Success;
@@ -334,24 +385,27 @@ extern "C" PLUGIN_API Status RemovePermissionGroup(const int64_t pluginID, const
         return Status::GroupNotFound;
 
 	bool w_wildcard;
-	const auto oldState = it->second->hasPermission(perm, true, w_wildcard);
+	const auto oldState = it->second->current().hasPermission(perm, true, w_wildcard);
 	if (oldState == Status::PermNotFound)
 		return Status::PermNotFound;
 
     plg::vector<plg::string> deleted_perms;
 
 	{
-		std::unique_lock lock2(users_mtx); // Need to eliminate race in user->group permissions check
-    	const bool ret = it->second->_nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
+		GroupVersion* version = it->second->edit();
+    	const bool ret = version->nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
     	if (!ret)
+    	{
+    		delete version;
     		return Status::PermNotFound;
+    	}
+		it->second->publish(version);
+    	RefreshGroups();
+    	RefreshUsers();
 	}
-    {
-        std::shared_lock lock3(group_permission_callbacks._lock);
-        for (const GroupPermissionCallback cb : group_permission_callbacks._callbacks)
-            for (const plg::string& s : deleted_perms)
-                cb(pluginID, Action::Remove, s, perm, oldState, Status::PermNotFound);
-    }
+    for (plg::string& s : deleted_perms)
+        g_EventQueue.push(GroupPermissionEvent{pluginID, Action::Remove, name, std::move(s), oldState,
+                                               Status::PermNotFound});
     return Status::Success;
 }
 
@@ -368,15 +422,15 @@ extern "C" PLUGIN_API Status GetOptionGroup(const plg::string& groupName, const
 {
     const uint64_t hash = XXH3_64bits(groupName.data(), groupName.size());
     std::shared_lock lock(groups_mtx);
-    const auto v = groups.find(hash);
-    if (v == groups.end())
+    const Group* g = ViewGroupByHash(hash);
+    if (g == nullptr)
         return Status::GroupNotFound;
 
-    Group* g = v->second;
     while (g != nullptr)
     {
-        const auto val = g->options.find(optionName);
-        if (val == g->options.end())
+        const GroupVersion& version = g->current();
+        const auto val = version.options.find(optionName);
+        if (val == version.options.end())
         {
             g = g->_parent;
             continue;
@@ -405,13 +459,11 @@ extern "C" PLUGIN_API Status SetOptionGroup(const int64_t pluginID, const plg::s
     if (v == groups.end())
         return Status::GroupNotFound;
 
-    std::unique_lock lock2(users_mtx); // Need to eliminate race in user->group permissions check
-    {
-        std::shared_lock lock3(set_option_group_callbacks._lock);
-        for (const SetOptionGroupCallback cb : set_option_group_callbacks._callbacks)
-            cb(pluginID, groupName, optionName, value);
-    }
-    v->second->options[optionName] = value;
+    g_EventQueue.push(SetOptionGroupEvent{pluginID, groupName, optionName, value});
+    // Options are read by users straight from group versions, nothing to rebuild
+    GroupVersion* version = v->second->edit();
+    version->options[optionName] = value;
+    v->second->publish(version);
     return Status::Success;
 }
 
@@ -429,14 +481,14 @@ extern "C" PLUGIN_API Status GetAllOptionsGroup(const plg::string& groupName, pl
 {
     const uint64_t hash = XXH3_64bits(groupName.data(), groupName.size());
     std::shared_lock lock(groups_mtx);
-    const auto v = groups.find(hash);
-    if (v == groups.end())
+    const Group* group = ViewGroupByHash(hash);
+    if (group == nullptr)
         return Status::GroupNotFound;
 
     optionNames.clear();
     values.clear();
 
-    for (const auto& [kv, vv] : v->second->options)
+    for (const auto& [kv, vv] : group->current().options)
     {
         optionNames.push_back(kv);
         values.push_back(vv);
@@ -474,11 +526,7 @@ extern "C" PLUGIN_API Status CreateGroup(const int64_t pluginID, const plg::stri
 
     auto* group = new Group(perms, name, priority, parentGroup);
     groups.try_emplace(hash, group);
-    {
-        std::shared_lock lock2(group_create_callbacks._lock);
-        for (const GroupCreateCallback cb : group_create_callbacks._callbacks)
-            cb(pluginID, name, perms, priority, parent);
-    }
+    g_EventQueue.push(GroupCreateEvent{pluginID, name, perms, priority, parent});
     return Status::Success;
 }
 
@@ -497,11 +545,6 @@ extern "C" PLUGIN_API Status DeleteGroup(const int64_t pluginID, const plg::stri
     if (it == groups.end())
         return Status::GroupNotFound;
 
-    {
-        std::shared_lock lock2(group_delete_callbacks._lock);
-        for (const GroupDeleteCallback cb : group_delete_callbacks._callbacks)
-            cb(pluginID, name);
-    }
     const Group* req_group = it->second;
     groups.erase(it);
 
@@ -519,9 +562,11 @@ extern "C" PLUGIN_API Status DeleteGroup(const int64_t pluginID, const plg::stri
             cur_group = cur_group->_parent;
         }
     }
+    RefreshGroups();
 
     GroupManager_Callback(req_group); // Delete group in users
-    delete req_group;
+    req_group->current().nodes.unindexAll();
+    g_EventQueue.push(GroupDeleteEvent{pluginID, name, req_group}); // listeners still read it, retired after them
     return Status::Success;
 }
 
@@ -535,8 +580,7 @@ extern "C" PLUGIN_API bool GroupExists(const plg::string& name)
 {
     const uint64_t hash = XXH3_64bits(name.data(), name.size());
     std::unique_lock lock(groups_mtx);
-    const auto v = groups.find(hash);
-    return v != groups.end();
+    return ViewGroupByHash(hash) != nullptr;
 }
 
 /**
@@ -547,15 +591,13 @@ extern "C" PLUGIN_API bool GroupExists(const plg::string& name)
  * It does not perform any storage operations itself — the actual
  * loading logic is handled by subscribed extensions (e.g., database providers).
  *
- * Thread-safe: acquires a shared lock while iterating over callbacks.
+ * Thread-safe: listeners are read without locks.
  *
  * @param pluginID Identifier of the plugin that calls the method.
  */
 extern "C" PLUGIN_API void LoadGroups(const int64_t pluginID)
 {
-    std::shared_lock lock2(load_groups_callbacks._lock);
-    for (const LoadGroupsCallback cb : load_groups_callbacks._callbacks)
-        cb(pluginID);
+    load_groups_callbacks.invoke(pluginID);
 }
 
 /**
@@ -566,9 +608,7 @@ extern "C" PLUGIN_API void LoadGroups(const int64_t pluginID)
  */
 extern "C" PLUGIN_API Status OnLoadGroups_Register(LoadGroupsCallback callback)
 {
-    std::unique_lock lock(load_groups_callbacks._lock);
-    auto ret = load_groups_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return load_groups_callbacks.add(callback);
 }
 
 /**
@@ -579,9 +619,7 @@ extern "C" PLUGIN_API Status OnLoadGroups_Register(LoadGroupsCallback callback)
  */
 extern "C" PLUGIN_API Status OnLoadGroups_Unregister(LoadGroupsCallback callback)
 {
-    std::unique_lock lock(load_groups_callbacks._lock);
-    const size_t ret = load_groups_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return load_groups_callbacks.remove(callback);
 }
 
 /**
@@ -592,9 +630,7 @@ extern "C" PLUGIN_API Status OnLoadGroups_Unregister(LoadGroupsCallback callback
  */
 extern "C" PLUGIN_API Status OnGroupSetParent_Register(SetParentCallback callback)
 {
-    std::unique_lock lock(set_parent_callbacks._lock);
-    auto ret = set_parent_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return set_parent_callbacks.add(callback);
 }
 
 /**
@@ -605,9 +641,7 @@ extern "C" PLUGIN_API Status OnGroupSetParent_Register(SetParentCallback callbac
  */
 extern "C" PLUGIN_API Status OnGroupSetParent_Unregister(SetParentCallback callback)
 {
-    std::unique_lock lock(set_parent_callbacks._lock);
-    const size_t ret = set_parent_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return set_parent_callbacks.remove(callback);
 }
 
 /**
@@ -618,9 +652,7 @@ extern "C" PLUGIN_API Status OnGroupSetParent_Unregister(SetParentCallback callb
  */
 extern "C" PLUGIN_API Status OnGroupSetOption_Register(SetOptionGroupCallback callback)
 {
-    std::unique_lock lock(set_option_group_callbacks._lock);
-    auto ret = set_option_group_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return set_option_group_callbacks.add(callback);
 }
 
 /**
@@ -631,9 +663,7 @@ extern "C" PLUGIN_API Status OnGroupSetOption_Register(SetOptionGroupCallback ca
  */
 extern "C" PLUGIN_API Status OnGroupSetOption_Unregister(SetOptionGroupCallback callback)
 {
-    std::unique_lock lock(set_option_group_callbacks._lock);
-    const size_t ret = set_option_group_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return set_option_group_callbacks.remove(callback);
 }
 
 /**
@@ -644,9 +674,7 @@ extern "C" PLUGIN_API Status OnGroupSetOption_Unregister(SetOptionGroupCallback
  */
 extern "C" PLUGIN_API Status OnGroupPermissionChange_Register(GroupPermissionCallback callback)
 {
-    std::unique_lock lock(group_permission_callbacks._lock);
-    auto ret = group_permission_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return group_permission_callbacks.add(callback);
 }
 
 /**
@@ -657,9 +685,7 @@ extern "C" PLUGIN_API Status OnGroupPermissionChange_Register(GroupPermissionCal
  */
 extern "C" PLUGIN_API Status OnGroupPermissionChange_Unregister(GroupPermissionCallback callback)
 {
-    std::unique_lock lock(group_permission_callbacks._lock);
-    const size_t ret = group_permission_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return group_permission_callbacks.remove(callback);
 }
 
 /**
@@ -670,9 +696,7 @@ extern "C" PLUGIN_API Status OnGroupPermissionChange_Unregister(GroupPermissionC
  */
 extern "C" PLUGIN_API Status OnGroupCreate_Register(GroupCreateCallback callback)
 {
-    std::unique_lock lock(group_create_callbacks._lock);
-    auto ret = group_create_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return group_create_callbacks.add(callback);
 }
 
 /**
@@ -683,9 +707,7 @@ extern "C" PLUGIN_API Status OnGroupCreate_Register(GroupCreateCallback callback
  */
 extern "C" PLUGIN_API Status OnGroupCreate_Unregister(GroupCreateCallback callback)
 {
-    std::unique_lock lock(group_create_callbacks._lock);
-    const size_t ret = group_create_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return group_create_callbacks.remove(callback);
 }
 
 /**
@@ -696,9 +718,7 @@ extern "C" PLUGIN_API Status OnGroupCreate_Unregister(GroupCreateCallback callba
  */
 extern "C" PLUGIN_API Status OnGroupDelete_Register(GroupDeleteCallback callback)
 {
-    std::unique_lock lock(group_delete_callbacks._lock);
-    auto ret = group_delete_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return group_delete_callbacks.add(callback);
 }
 
 /**
@@ -709,9 +729,7 @@ extern "C" PLUGIN_API Status OnGroupDelete_Register(GroupDeleteCallback callback
  */
 extern "C" PLUGIN_API Status OnGroupDelete_Unregister(GroupDeleteCallback callback)
 {
-    std::unique_lock lock(group_delete_callbacks._lock);
-    const size_t ret = group_delete_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return group_delete_callbacks.remove(callback);
 }
 
 PLUGIFY_WARN_POP()
@@ -1,8 +1,8 @@
 #include "user_manager.h"
 
-phmap::flat_hash_map<uint64_t, User> users;
+#include <numeric>
 
-std::shared_mutex users_mtx;
+UserMap users;
 
 UserPermissionCallbacks user_permission_callbacks;
 
@@ -19,45 +19,181 @@ GroupExpirationCallbacks group_expiration_callbacks;
 UserLoadCallbacks user_load_callbacks;
 // UserLoadedCallbacks user_loaded_callbacks;
 
-void g_PermExpirationCallback([[maybe_unused]] uint32_t timer, const plg::vector<plg::any>& userData)
+ChangeBatchCallbacks change_batch_callbacks;
+
+void DispatchEvent(const UserPermissionEvent& e)
+{
+    user_permission_callbacks.invoke(e.pluginID, e.action, e.targetID, e.perm, e.oldState, e.newState, e.oldTimestamp, e.newTimestamp);
+}
+
+void DispatchEvent(const UserSetCookieEvent& e)
+{
+    user_set_cookie_callbacks.invoke(e.pluginID, e.targetID, e.name, e.cookie);
+}
+
+void DispatchEvent(const UserGroupEvent& e)
+{
+    user_group_callbacks.invoke(e.pluginID, e.action, e.targetID, e.group, e.oldTimestamp, e.newTimestamp);
+}
+
+void DispatchEvent(const UserCreateEvent& e)
+{
+    user_create_callbacks.invoke(e.pluginID, e.targetID, e.immunity, e.offline, e.groupNames);
+}
+
+void DispatchEvent(const UserDeleteEvent& e)
 {
-    const plg::string* perm = &plg::get<plg::string>(userData[0]);
-    const bool state = plg::get<bool>(userData[1]);
-    const uint64_t targetID = plg::get<uint64_t>(userData[2]);
-    plg::vector<plg::string> deleted_perms;
     {
-        std::unique_lock lock(users_mtx);
-        const auto it = users.find(targetID);
-        if (it == users.end())
-            return;
-        it->second.temp_nodes.deletePerm(*perm, false, deleted_perms);
+        UserMap::DepartedScope departed(e.targetID, e.user);
+        user_delete_callbacks.invoke(e.pluginID, e.targetID);
     }
+    g_Epoch.retire(e.user);
+    g_Epoch.collectBatch();
+}
 
-    std::shared_lock lock(perm_expiration_callbacks._lock);
-    for (const auto& callback : perm_expiration_callbacks._callbacks)
-        for (const plg::string& s : deleted_perms)
-            callback(targetID, s, state ? Status::Allow : Status::Disallow);
+void DispatchEvent(const PermExpirationEvent& e)
+{
+    perm_expiration_callbacks.invoke(e.targetID, e.perm, e.state);
 }
 
-void g_GroupExpirationCallback(uint32_t /*timer*/, const plg::vector<plg::any>& userData)
+void DispatchEvent(const GroupExpirationEvent& e)
 {
-    const plg::string* group_name = &plg::get<plg::string>(userData[0]);
-    uint64_t targetID = plg::get<uint64_t>(userData[1]);
+    group_expiration_callbacks.invoke(e.targetID, e.group);
+}
+
+void DispatchBatch(const plg::vector<Event>& events)
+{
+    if (change_batch_callbacks.empty())
+        return;
+
+    plg::vector<int64_t> pluginIDs;
+    plg::vector<ChangeKind> kinds;
+    plg::vector<Action> actions;
+    plg::vector<uint64_t> targetIDs;
+    plg::vector<plg::string> groupNames;
+    plg::vector<plg::string> perms;
+    plg::vector<Status> oldStates;
+    plg::vector<Status> newStates;
+    plg::vector<int64_t> oldTimestamps;
+    plg::vector<int64_t> newTimestamps;
+    auto add = [&](const int64_t pluginID, const ChangeKind kind, const Action action, const uint64_t targetID,
+                   const plg::string& group, const plg::string& perm, const Status oldState, const Status newState,
+                   const time_t oldTimestamp, const time_t newTimestamp) {
+        pluginIDs.push_back(pluginID);
+        kinds.push_back(kind);
+        actions.push_back(action);
+        targetIDs.push_back(targetID);
+        groupNames.push_back(group);
+        perms.push_back(perm);
+        oldStates.push_back(oldState);
+        newStates.push_back(newState);
+        oldTimestamps.push_back(oldTimestamp);
+        newTimestamps.push_back(newTimestamp);
+    };
+
+    for (const Event& event : events)
     {
-        std::unique_lock lock(users_mtx);
-        const Group* g = GetGroup(*group_name);
-        if (g == nullptr)
-            return;
-        const auto it = users.find(targetID);
-        if (it == users.end())
-            return;
-        if (!it->second.delGroup(g))
-            return;
+        if (const auto* up = std::get_if<UserPermissionEvent>(&event))
+            add(up->pluginID, ChangeKind::UserPermission, up->action, up->targetID, {}, up->perm, up->oldState,
+                up->newState, up->oldTimestamp, up->newTimestamp);
+        else if (const auto* gp = std::get_if<GroupPermissionEvent>(&event))
+            add(gp->pluginID, ChangeKind::GroupPermission, gp->action, 0, gp->groupName, gp->perm, gp->oldState,
+                gp->newState, 0, 0);
+        else if (const auto* ug = std::get_if<UserGroupEvent>(&event))
+            add(ug->pluginID, ChangeKind::UserGroup, ug->action, ug->targetID, ug->group, {}, Status::PermNotFound,
+                Status::PermNotFound, ug->oldTimestamp, ug->newTimestamp);
+        // Expirations are removals made by the core itself
+        else if (const auto* pe = std::get_if<PermExpirationEvent>(&event))
+            add(0, ChangeKind::UserPermission, Action::Remove, pe->targetID, {}, pe->perm, pe->state,
+                Status::PermNotFound, pe->timestamp, 0);
+        else if (const auto* ge = std::get_if<GroupExpirationEvent>(&event))
+            add(0, ChangeKind::UserGroup, Action::Remove, ge->targetID, ge->group, {}, Status::PermNotFound,
+                Status::PermNotFound, ge->timestamp, 0);
+    }
+
+    if (!pluginIDs.empty())
+        change_batch_callbacks.invoke(pluginIDs, kinds, actions, targetIDs, groupNames, perms, oldStates, newStates,
+                                      oldTimestamps, newTimestamps);
+}
+
+// Expire temporary permissions and groups of one user from timers fired in the same frame, publishing one new version.
+// A grant which was given again or removed while its timer was on the way stays as it is now.
+static void ExpireUser(const uint64_t targetID, const plg::vector<FiredTimer>& timers, const uint32_t* first,
+                       const uint32_t* last, const time_t timestamp)
+{
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
+        return;
+
+    User* user = nullptr;
+    bool perms_changed = false;
+    plg::vector<plg::string> deleted_perms;
+    for (const uint32_t* i = first; i != last; ++i)
+    {
+        const FiredTimer& fired = timers[*i];
+        const User* current = user ? user : v;
+        if (fired.data.type == ExpirationType::Permission)
+        {
+            const std::string_view perm = g_LineTable.line(fired.data.perm);
+            const Node* node = current->temp_nodes.findLine(perm);
+            if (node == nullptr || node->timer != fired.id || node->timestamp > timestamp)
+                continue;
+            if (user == nullptr)
+                user = new User(*v);
+            const time_t expired = node->timestamp;
+            deleted_perms.clear();
+            perms_changed |= user->temp_nodes.erasePerm(perm, false, deleted_perms);
+            for (plg::string& s : deleted_perms)
+                g_EventQueue.push(PermExpirationEvent{targetID, std::move(s),
+                                                      fired.data.state ? Status::Allow : Status::Disallow, expired});
+        }
+        else
+        {
+            const Group* g = FindGroupByHash(fired.data.group);
+            if (g == nullptr)
+                continue;
+            const TempGroup* tg = current->findGroup(g);
+            if (tg == nullptr || tg->timer != fired.id || tg->timestamp > timestamp)
+                continue;
+            const time_t expired = tg->timestamp;
+            if (user == nullptr)
+                user = new User(*v);
+            user->delGroup(g);
+            g_EventQueue.push(GroupExpirationEvent{targetID, g->_name, expired});
+        }
     }
 
-    std::shared_lock lock(group_expiration_callbacks._lock);
-    for (const auto& callback : group_expiration_callbacks._callbacks)
-        callback(targetID, *group_name);
+    if (user == nullptr)
+        return;
+    if (perms_changed)
+        user->temp_nodes.recompile();
+    user->refresh();
+    users.publish(targetID, user);
+}
+
+// Timers fired in one frame are applied per user: one lock and one new version of the user for all its expirations.
+// Listeners get the expirations on the next drain of the event queue.
+void g_ExpirationCallback(const plg::vector<FiredTimer>& timers, const time_t timestamp)
+{
+    // Timers by user, in order of firing for every user
+    plg::vector<uint32_t> order(timers.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::ranges::stable_sort(order, {}, [&timers](const uint32_t i) { return timers[i].data.targetID; });
+
+    std::shared_lock groups_lock(groups_mtx, std::defer_lock);
+    if (std::ranges::any_of(timers, [](const FiredTimer& t) { return t.data.type == ExpirationType::Group; }))
+        groups_lock.lock();
+
+    for (size_t i = 0; i < order.size();)
+    {
+        const uint64_t targetID = timers[order[i]].data.targetID;
+        size_t end = i + 1;
+        while (end < order.size() && timers[order[end]].data.targetID == targetID)
+            ++end;
+        ExpireUser(targetID, timers, order.data() + i, order.data() + end, timestamp);
+        i = end;
+    }
 }
 
 PLUGIFY_WARN_PUSH()
@@ -77,13 +213,13 @@ PLUGIFY_WARN_IGNORE (4190)
  */
 extern "C" PLUGIN_API Status DumpPermissions(const uint64_t targetID, plg::vector<plg::string>& perms)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    perms = Node::dumpNode(v->second.user_nodes);
-    perms.append_range(Node::dumpNode(v->second.temp_nodes));
+    perms = v->user_nodes.dump();
+    perms.append_range(v->temp_nodes.dump());
 
     return Status::Success;
 }
@@ -97,16 +233,16 @@ extern "C" PLUGIN_API Status DumpPermissions(const uint64_t targetID, plg::vecto
  */
 extern "C" PLUGIN_API Status CanAffectUser(const uint64_t actorID, const uint64_t targetID)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v1 = users.find(actorID);
-    const auto v2 = users.find(targetID);
-    if (v1 == users.end())
+    EpochGuard guard;
+    const User* v1 = users.view(actorID);
+    const User* v2 = users.view(targetID);
+    if (v1 == nullptr)
         return Status::ActorUserNotFound;
-    if (v2 == users.end())
+    if (v2 == nullptr)
         return Status::TargetUserNotFound;
 
-    const int i1 = v1->second.getImmunity();
-    const int i2 = v2->second.getImmunity();
+    const int i1 = v1->getImmunity();
+    const int i2 = v2->getImmunity();
 
     return i1 >= i2 ? Status::Allow : Status::Disallow;
 }
@@ -128,9 +264,9 @@ extern "C" PLUGIN_API Status HasPermissionExtended(const uint64_t targetID, cons
 		return Status::Error;
     timestamp = -1;
     permSource = PermSource::NotFound;
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     if (perm.empty()) {
@@ -138,7 +274,7 @@ extern "C" PLUGIN_API Status HasPermissionExtended(const uint64_t targetID, cons
     }
 
     bool w_wildcard;
-    const Status status = v->second.hasPermission(perm, permSource, exact, w_wildcard, timestamp);
+    const Status status = v->hasPermission(perm, permSource, exact, w_wildcard, timestamp);
     if (exact && isWildcard(perm) != w_wildcard)
         return Status::PermNotFound;
     return status;
@@ -158,6 +294,121 @@ extern "C" PLUGIN_API Status HasPermission(const uint64_t targetID, const plg::s
     return HasPermissionExtended(targetID, perm, false, permSource, timestamp);
 }
 
+/**
+ * @brief Check if a user has specific permissions.
+ *
+ * All lines are checked against one version of the user, found with one lookup. Leading segments shared
+ * with the previous line are resolved only once, so passing lines grouped by prefix is the cheapest.
+ *
+ * @param targetID Player ID.
+ * @param perms Permission lines.
+ * @param exact Checking permissions with ignoring wildcards (pass 'false' for default behavior).
+ * @param outStatuses Status for every permission line: Allow, Disallow, PermNotFound or Error (empty line).
+ * @return Success, TargetUserNotFound
+ */
+extern "C" PLUGIN_API Status HasPermissionsExtended(const uint64_t targetID, const plg::vector<plg::string>& perms,
+                                                    const bool exact, plg::vector<Status>& outStatuses)
+{
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
+    {
+        outStatuses.assign(perms.size(), Status::TargetUserNotFound);
+        return Status::TargetUserNotFound;
+    }
+
+    v->hasPermissions(perms, exact, outStatuses);
+    return Status::Success;
+}
+
+/**
+ * @brief Check if a user has specific permissions.
+ *
+ * @param targetID Player ID.
+ * @param perms Permission lines.
+ * @param outStatuses Status for every permission line: Allow, Disallow, PermNotFound or Error (empty line).
+ * @return Success, TargetUserNotFound
+ */
+extern "C" PLUGIN_API Status HasPermissions(const uint64_t targetID, const plg::vector<plg::string>& perms,
+                                            plg::vector<Status>& outStatuses)
+{
+    return HasPermissionsExtended(targetID, perms, false, outStatuses);
+}
+
+/**
+ * @brief Register a permission line for handle-based checks.
+ *
+ * The line is split and resolved once, so checks by handle skip parsing entirely.
+ * Registering the same line twice returns the same handle.
+ *
+ * @param perm Permission line.
+ * @return Permission handle, or InvalidPermHandle (0xFFFFFFFF) if the line is empty.
+ */
+extern "C" PLUGIN_API uint32_t RegisterPermission(const plg::string& perm)
+{
+    bool inserted;
+    const uint32_t handle = g_PermRegistry.registerPerm(perm, inserted);
+    if (inserted && handle < MaxIndexedPerms)
+    {
+        // Evaluate new bit for groups, there are few of them. Users check it in their trie until their next
+        // refresh() picks a trie which has it, copying every user here would stall all changes for each
+        // registration.
+        std::unique_lock lock(groups_mtx);
+        for (Group* g : groups | std::views::values)
+            g->updateBits(g->current().bits.size);
+    }
+    return handle;
+}
+
+/**
+ * @brief Check if a user has a registered permission.
+ *
+ * @param targetID Player ID.
+ * @param handle Permission handle returned by RegisterPermission.
+ * @return Allow, Disallow, PermNotFound, TargetUserNotFound, Error
+ */
+extern "C" PLUGIN_API Status HasPermissionByHandle(const uint64_t targetID, const uint32_t handle)
+{
+    const RegisteredPerm* rp = g_PermRegistry.get(handle);
+    if (rp == nullptr)
+        return Status::Error;
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
+        return Status::TargetUserNotFound;
+
+    if (v->_effective->bits.contains(handle))
+        return v->_effective->bits.test(handle);
+
+    PermSource permSource;
+    bool w_wildcard;
+    time_t timestamp;
+    return v->hasPermission(*rp, permSource, false, w_wildcard, timestamp);
+}
+
+/**
+ * @brief Check if a user has all registered permissions.
+ *
+ * Permissions registered among the first MaxIndexedPerms (4096) are checked a word of bits at a time,
+ * the rest are checked one by one.
+ *
+ * @param targetID Player ID.
+ * @param handles Permission handles returned by RegisterPermission.
+ * @return Allow if all are allowed, Disallow if any is denied, otherwise PermNotFound; TargetUserNotFound, Error
+ */
+extern "C" PLUGIN_API Status HasAllPermissionsByHandle(const uint64_t targetID, const plg::vector<uint32_t>& handles)
+{
+    for (const uint32_t handle : handles)
+        if (g_PermRegistry.get(handle) == nullptr)
+            return Status::Error;
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
+        return Status::TargetUserNotFound;
+
+    return v->hasAllPermissions(handles);
+}
+
 /**
  * @brief Check if a user belongs to a specific group (directly or via parent groups).
  *
@@ -169,21 +420,18 @@ extern "C" PLUGIN_API Status HasPermission(const uint64_t targetID, const plg::s
 extern "C" PLUGIN_API Status HasGroupExtended(const uint64_t targetID, const plg::string& groupName, time_t& timestamp)
 {
     timestamp = -1;
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    const Group* g = GetGroup(groupName);
-    if (g == nullptr)
-        return Status::GroupNotFound;
-
-    for (const auto& temp_group : v->second._groups)
+    // Group names are unique, so the groups of user are matched by name and groups lock is taken only on a miss
+    for (const auto& temp_group : v->_groups)
     {
         const Group* parent = temp_group.group;
         while (parent)
         {
-            if (parent == g) {
+            if (parent->_name == groupName) {
                 timestamp = temp_group.timestamp;
                 return timestamp == 0 ? Status::PermanentGroup : Status::TemporalGroup;
             }
@@ -191,7 +439,7 @@ extern "C" PLUGIN_API Status HasGroupExtended(const uint64_t targetID, const plg
             parent = parent->_parent;
         }
     }
-    return Status::GroupNotDefined;
+    return GetGroup(groupName) == nullptr ? Status::GroupNotFound : Status::GroupNotDefined;
 }
 
 /**
@@ -216,14 +464,14 @@ extern "C" PLUGIN_API Status HasGroup(const uint64_t targetID, const plg::string
  */
 extern "C" PLUGIN_API Status GetUserGroups(const uint64_t targetID, plg::vector<plg::string>& outGroups)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     outGroups.clear();
-    outGroups.reserve(v->second._groups.size());
-    for (const auto& g : v->second._groups)
+    outGroups.reserve(v->_groups.size());
+    for (const auto& g : v->_groups)
     {
         plg::string s = g.group->_name;
         if (g.timestamp != 0)
@@ -246,11 +494,11 @@ extern "C" PLUGIN_API Status GetUserGroups(const uint64_t targetID, plg::vector<
  */
 extern "C" PLUGIN_API Status GetImmunity(const uint64_t targetID, int& immunity)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
-    immunity = v->second.getImmunity();
+    immunity = v->getImmunity();
     return Status::Success;
 }
 
@@ -263,11 +511,13 @@ extern "C" PLUGIN_API Status GetImmunity(const uint64_t targetID, int& immunity)
  */
 extern "C" PLUGIN_API Status SetImmunity(const uint64_t targetID, const int immunity)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
-    v->second._immunity = immunity;
+    auto* user = new User(*v);
+    user->_immunity = immunity;
+    users.publish(targetID, user);
     return Status::Success;
 }
 
@@ -286,16 +536,16 @@ extern "C" PLUGIN_API Status AddPermission(const int64_t pluginID, const uint64_
 {
 	if (perm.empty())
 		return Status::Error;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     PermSource perm_type;
     const bool denied = perm.starts_with('-');
     bool w_wildcard;
     time_t old_timestamp = -1;
-    const Status oldState = v->second.hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
+    const Status oldState = v->hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
     bool diff = !((denied && oldState == Status::Disallow) || (!denied && oldState == Status::Allow));
 
     bool replaceToWC = false;
@@ -330,32 +580,30 @@ extern "C" PLUGIN_API Status AddPermission(const int64_t pluginID, const uint64_
 
 	plg::vector<plg::string> deleted_perms;
 
+    auto* user = new User(*v);
     if (timestamp != 0)
     {
-        v->second.addTempPerm(perm, timestamp, targetID);
+        user->addTempPerm(perm, timestamp, targetID);
     }
     else
     {
         if (perm_type == PermSource::UserTemp)
         {
-            v->second.temp_nodes.deletePerm(perm, false, deleted_perms);
+            user->temp_nodes.deletePerm(perm, false, deleted_perms);
         }
-        v->second.user_nodes.addPerm(perm);
+        user->user_nodes.addPerm(perm);
     }
+    if (replaceToWC && !dontBroadcast && timestamp != old_timestamp && timestamp == 0)
+        user->temp_nodes.deletePerm(std::string_view(perm).substr(0, perm.length() - 2), false, deleted_perms);
+    user->refresh();
+    users.publish(targetID, user);
 
     if (!dontBroadcast)
     {
-        if (replaceToWC) {
+        if (replaceToWC)
 	        act = Action::ReplaceToWC;
-        	if (timestamp != old_timestamp && timestamp == 0)
-        	{
-        		v->second.temp_nodes.deletePerm(std::string_view(perm).substr(0, perm.length() - 2), false, deleted_perms);
-        	}
-        }
-    	const plg::string prm = denied ? perm.substr(1) : perm;
-        std::shared_lock lock2(user_permission_callbacks._lock);
-        for (const UserPermissionCallback cb : user_permission_callbacks._callbacks)
-            cb(pluginID, act, targetID, prm, oldState, denied ? Status::Disallow : Status::Allow, old_timestamp, timestamp);
+        g_EventQueue.push(UserPermissionEvent{pluginID, act, targetID, denied ? perm.substr(1) : perm, oldState,
+                                              denied ? Status::Disallow : Status::Allow, old_timestamp, timestamp});
     }
     return Status::Success;
 }
@@ -375,16 +623,16 @@ extern "C" PLUGIN_API Status SetPermission(const int64_t pluginID, const uint64_
 {
 	if (perm.empty())
 		return Status::Error;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     PermSource perm_type;
     const bool denied = perm.starts_with('-');
     bool w_wildcard;
     time_t old_timestamp = -1;
-    const Status oldState = v->second.hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
+    const Status oldState = v->hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
     bool diff = !((denied && oldState == Status::Disallow) || (!denied && oldState == Status::Allow));
 
     bool replaceToWC = false;
@@ -405,44 +653,42 @@ extern "C" PLUGIN_API Status SetPermission(const int64_t pluginID, const uint64_
 
     Action act = Action::Add;
 
-    plg::vector<plg::string> deleted_perms;
     switch (perm_type)
     {
         case PermSource::UserTemp:
             if (old_timestamp == timestamp && !diff)
                 return Status::PermAlreadyGranted;
-
-            if (timestamp == 0)
-                v->second.temp_nodes.deletePerm(perm, false, deleted_perms);
-
             act = Action::Replace;
             break;
         case PermSource::User:
             if (timestamp == 0 && !diff)
                 return Status::PermAlreadyGranted;
-
-            if (timestamp != 0)
-                v->second.user_nodes.deletePerm(perm, false, deleted_perms);
-
             act = Action::Replace;
             break;
         default:
             break;
     }
 
+    plg::vector<plg::string> deleted_perms;
+    auto* user = new User(*v);
+    if (perm_type == PermSource::UserTemp && timestamp == 0)
+        user->temp_nodes.deletePerm(perm, false, deleted_perms);
+    else if (perm_type == PermSource::User && timestamp != 0)
+        user->user_nodes.deletePerm(perm, false, deleted_perms);
+
     if (timestamp != 0)
-        v->second.addTempPerm(perm, timestamp, targetID);
+        user->addTempPerm(perm, timestamp, targetID);
     else
-        v->second.user_nodes.addPerm(perm);
+        user->user_nodes.addPerm(perm);
+    user->refresh();
+    users.publish(targetID, user);
 
     if (!dontBroadcast)
     {
         if (replaceToWC)
             act = Action::ReplaceToWC;
-    	const plg::string prm = denied ? perm.substr(1) : perm;
-        std::shared_lock lock2(user_permission_callbacks._lock);
-        for (const UserPermissionCallback cb : user_permission_callbacks._callbacks)
-            cb(pluginID, act, targetID, prm, oldState, denied ? Status::Disallow : Status::Allow, old_timestamp, timestamp);
+        g_EventQueue.push(UserPermissionEvent{pluginID, act, targetID, denied ? perm.substr(1) : perm, oldState,
+                                              denied ? Status::Disallow : Status::Allow, old_timestamp, timestamp});
     }
     return Status::Success;
 }
@@ -462,32 +708,35 @@ extern "C" PLUGIN_API Status RemovePermission(const int64_t pluginID, const uint
 	if (perm.empty())
 		return Status::Error;
     PermSource perm_type;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     bool w_wildcard;
     time_t old_timestamp = -1;
-    const auto oldState = v->second.hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
+    const auto oldState = v->hasPermission(perm, perm_type, true, w_wildcard, old_timestamp);
     if (perm_type > PermSource::User)
         return Status::PermNotFound; // Because this permission is in Groups, or not found at all
 
     plg::vector<plg::string> deleted_perms;
+    auto* user = new User(*v);
 	bool ret;
     if (perm_type == PermSource::User)
-        ret = v->second.user_nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
+        ret = user->user_nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
     else
-        ret = v->second.temp_nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
+        ret = user->temp_nodes.deletePerm(perm, recursiveDeletion, deleted_perms);
 	if (!ret)
+	{
+		delete user;
 		return Status::PermNotFound;
+	}
+    user->refresh();
+    users.publish(targetID, user);
 
-    {
-        std::shared_lock lock2(user_permission_callbacks._lock);
-        for (const UserPermissionCallback cb : user_permission_callbacks._callbacks)
-            for (const plg::string& s : deleted_perms)
-                cb(pluginID, Action::Remove, targetID, s, oldState, Status::PermNotFound, old_timestamp, 0);
-    }
+    for (plg::string& s : deleted_perms)
+        g_EventQueue.push(UserPermissionEvent{pluginID, Action::Remove, targetID, std::move(s), oldState,
+                                              Status::PermNotFound, old_timestamp, 0});
 
     return Status::Success;
 }
@@ -507,19 +756,20 @@ extern "C" PLUGIN_API Status AddGroup(const int64_t pluginID, const uint64_t tar
 {
 	if (groupName.empty())
 		return Status::Error;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    std::shared_lock groups_lock(groups_mtx); // groups first, same order as group changes which then refresh users
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    Group* req_group = GetGroup(groupName);
+    Group* req_group = FindGroup(groupName);
     if (req_group == nullptr)
         return Status::GroupNotFound;
 
     time_t old_timestamp = -1;
     Action act = Action::Add;
 
-    for (const auto& temp_group : v->second._groups)
+    for (const auto& temp_group : v->_groups)
     {
         const Group* parent = temp_group.group;
         if (parent == req_group)
@@ -528,7 +778,6 @@ extern "C" PLUGIN_API Status AddGroup(const int64_t pluginID, const uint64_t tar
             if (temp_group.timestamp != timestamp)
             {
                 old_timestamp = temp_group.timestamp;
-                v->second.delGroup(parent);
                 act = Action::Replace;
                 break;
             }
@@ -543,14 +792,15 @@ extern "C" PLUGIN_API Status AddGroup(const int64_t pluginID, const uint64_t tar
         }
     }
 
-    v->second.addGroup(req_group, timestamp, targetID);
+    auto* user = new User(*v);
+    if (act == Action::Replace)
+        user->delGroup(req_group);
+    user->addGroup(req_group, timestamp, targetID);
+    user->refresh();
+    users.publish(targetID, user);
 
     if (!dontBroadcast)
-    {
-        std::shared_lock lock2(user_group_callbacks._lock);
-        for (const UserGroupCallback cb : user_group_callbacks._callbacks)
-            cb(pluginID, act, targetID, groupName, old_timestamp, timestamp);
-    }
+        g_EventQueue.push(UserGroupEvent{pluginID, act, targetID, groupName, old_timestamp, timestamp});
 
     return Status::Success;
 }
@@ -567,23 +817,25 @@ extern "C" PLUGIN_API Status RemoveGroup(const int64_t pluginID, const uint64_t
 {
 	if (groupName.empty())
 		return Status::Error;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    std::shared_lock groups_lock(groups_mtx); // groups first, same order as group changes which then refresh users
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    Group* g = GetGroup(groupName);
+    Group* g = FindGroup(groupName);
     if (g == nullptr)
         return Status::ChildGroupNotFound;
 
-    for (auto it = v->second._groups.begin(); it != v->second._groups.end(); it++)
+    for (auto it = v->_groups.begin(); it != v->_groups.end(); it++)
     {
         if (it->group == g)
         {
-            std::shared_lock lock2(user_group_callbacks._lock);
-            for (const UserGroupCallback cb : user_group_callbacks._callbacks)
-                cb(pluginID, Action::Remove, targetID, groupName, it->timestamp, 0);
-            v->second.delGroup(it->group);
+            g_EventQueue.push(UserGroupEvent{pluginID, Action::Remove, targetID, groupName, it->timestamp, 0});
+            auto* user = new User(*v);
+            user->delGroup(g);
+            user->refresh();
+            users.publish(targetID, user);
             return Status::Success;
         }
     }
@@ -602,23 +854,24 @@ extern "C" PLUGIN_API Status GetCookie(const uint64_t targetID, const plg::strin
 {
 	if (name.empty())
 		return Status::Error;
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    auto val = v->second.cookies.find(name);
-    bool found = val != v->second.cookies.end();
+    auto val = v->cookies.find(name);
+    bool found = val != v->cookies.end();
     if (!found)
     {
-        // Check in groups options
-        for (TempGroup& g : v->second._groups)
+        // Check in groups options, published versions of groups stay alive under the guard
+        for (const TempGroup& g : v->_groups)
         {
             Group* parent = g.group;
             while (parent)
             {
-                val = parent->options.find(name);
-                found = val != parent->options.end();
+                const GroupVersion& version = parent->current();
+                val = version.options.find(name);
+                found = val != version.options.end();
                 if (found)
                     break;
                 parent = parent->_parent;
@@ -645,18 +898,16 @@ extern "C" PLUGIN_API Status SetCookie(const int64_t pluginID, const uint64_t ta
 {
 	if (name.empty())
 		return Status::Error;
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    v->second.cookies[name] = cookie;
+    auto* user = new User(*v);
+    user->cookies[name] = cookie;
+    users.publish(targetID, user);
     if (!dontBroadcast)
-    {
-        std::shared_lock lock2(user_set_cookie_callbacks._lock);
-        for (const UserSetCookieCallback cb : user_set_cookie_callbacks._callbacks)
-            cb(pluginID, targetID, name, cookie);
-    }
+        g_EventQueue.push(UserSetCookieEvent{pluginID, targetID, name, cookie});
     return Status::Success;
 }
 
@@ -671,15 +922,15 @@ extern "C" PLUGIN_API Status SetCookie(const int64_t pluginID, const uint64_t ta
 extern "C" PLUGIN_API Status GetAllCookies(const uint64_t targetID, plg::vector<plg::string>& names,
                                            plg::vector<plg::any>& values)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
     names.clear();
     values.clear();
 
-    for (const auto& [kv, vv] : v->second.cookies)
+    for (const auto& [kv, vv] : v->cookies)
     {
         names.push_back(kv);
         values.push_back(vv);
@@ -701,7 +952,8 @@ extern "C" PLUGIN_API Status GetAllCookies(const uint64_t targetID, plg::vector<
 extern "C" PLUGIN_API Status CreateUser(const int64_t pluginID, const uint64_t targetID, const int immunity,
                                         const bool offline, const plg::vector<plg::string>& groupsList)
 {
-    std::unique_lock lock(users_mtx);
+    std::shared_lock groups_lock(groups_mtx); // groups first, same order as group changes which then refresh users
+    const auto lock = users.lock(targetID);
     if (users.contains(targetID))
         return Status::UserAlreadyExist;
 
@@ -710,17 +962,13 @@ extern "C" PLUGIN_API Status CreateUser(const int64_t pluginID, const uint64_t t
         std::string_view sv = name;
         if (sv.contains(' '))
             sv = sv.substr(0, sv.find(' '));
-        const Group* group = GetGroup(sv);
+        const Group* group = FindGroup(sv);
         if (group == nullptr)
             return Status::GroupNotFound;
     }
 
-    users.try_emplace(targetID, immunity, groupsList, targetID, offline);
-    {
-        std::shared_lock lock2(user_create_callbacks._lock);
-        for (const UserCreateCallback cb : user_create_callbacks._callbacks)
-            cb(pluginID, targetID, immunity, offline, groupsList);
-    }
+    users.insert(targetID, new User(immunity, groupsList, targetID, offline));
+    g_EventQueue.push(UserCreateEvent{pluginID, targetID, immunity, offline, groupsList});
     return Status::Success;
 }
 
@@ -733,18 +981,16 @@ extern "C" PLUGIN_API Status CreateUser(const int64_t pluginID, const uint64_t t
  */
 extern "C" PLUGIN_API Status DeleteUser(const int64_t pluginID, const uint64_t targetID)
 {
-    std::unique_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v == users.end())
+    const auto lock = users.lock(targetID);
+    const User* v = users.find(targetID);
+    if (v == nullptr)
         return Status::TargetUserNotFound;
 
-    {
-        std::shared_lock lock2(user_delete_callbacks._lock);
-        for (const UserDeleteCallback cb : user_delete_callbacks._callbacks)
-            cb(pluginID, targetID);
-    }
-    Node::destroyAllTimers(v->second.temp_nodes);
-    users.erase(v);
+    User* dead = users.erase(targetID);
+    Node::destroyAllTimers(dead->temp_nodes.root);
+    dead->user_nodes.unindexAll();
+    dead->temp_nodes.unindexAll();
+    g_EventQueue.push(UserDeleteEvent{pluginID, targetID, dead}); // listeners still read it, retired after them
     return Status::Success;
 }
 
@@ -756,10 +1002,10 @@ extern "C" PLUGIN_API Status DeleteUser(const int64_t pluginID, const uint64_t t
  */
 extern "C" PLUGIN_API PlayerState UserExists(const uint64_t targetID)
 {
-    std::shared_lock lock(users_mtx);
-    const auto v = users.find(targetID);
-    if (v != users.end()) {
-        return v->second._offline ? PlayerState::Offline : PlayerState::Online;
+    EpochGuard guard;
+    const User* v = users.view(targetID);
+    if (v != nullptr) {
+        return v->_offline ? PlayerState::Offline : PlayerState::Online;
     }
     return PlayerState::NotFound;
 }
@@ -771,8 +1017,115 @@ extern "C" PLUGIN_API PlayerState UserExists(const uint64_t targetID)
  */
 extern "C" PLUGIN_API plg::vector<uint64_t> DumpUsersList()
 {
-    auto keys_view = std::views::keys(users);
-    return {keys_view.begin(), keys_view.end()};
+    plg::vector<uint64_t> ids;
+    EpochGuard guard;
+    ids.reserve(users.size());
+    users.forEach([&ids](const uint64_t id, const User&) { ids.push_back(id); });
+    return ids;
+}
+
+/**
+ * @brief Returns IDs of all players who have a specific permission.
+ *
+ * The line is parsed once and all users are checked in one pass without locks. Users without own permissions
+ * share one check per distinct groups list.
+ *
+ * @param perm Permission line.
+ * @param onlyOnline Skip offline players.
+ * @return A vector containing IDs of players for whom the permission is allowed.
+ */
+extern "C" PLUGIN_API plg::vector<uint64_t> FilterUsersByPermission(const plg::string& perm, const bool onlyOnline)
+{
+    plg::vector<uint64_t> result;
+    if (perm.empty())
+        return result;
+    std::string_view line = perm;
+    if (line.starts_with('-'))
+        line = line.substr(1);
+    SegmentIds ids;
+    g_SegmentTable.lookup(line, ids);
+    const int sz = static_cast<int>(ids.size());
+
+    phmap::flat_hash_map<uint64_t, Status> by_groups;
+    EpochGuard guard;
+    users.forEach([&](const uint64_t id, const User& user) {
+        if (onlyOnline && user._offline)
+            return;
+
+        PermSource permSource;
+        bool w_wildcard;
+        time_t timestamp;
+        Status status;
+        if (user._groups_key != 0)
+        {
+            const auto [it, inserted] = by_groups.try_emplace(user._groups_key, Status::PermNotFound);
+            if (inserted)
+                it->second = user._hasPermission(ids.data(), sz, permSource, false, w_wildcard, timestamp);
+            status = it->second;
+        }
+        else
+            status = user._hasPermission(ids.data(), sz, permSource, false, w_wildcard, timestamp);
+
+        if (status == Status::Allow)
+            result.push_back(id);
+    });
+    return result;
+}
+
+/**
+ * @brief Get all users and groups which explicitly define a permission line.
+ *
+ * Served from an index kept up to date on every permission change, no user or group trees are scanned.
+ * Wildcard lines are distinct: "a.b.*" and "a.b" have separate holders.
+ *
+ * @param perm Permission line.
+ * @param outUsers Player IDs of users defining the line.
+ * @param outUserSources Source for every user: User or UserTemp (same user may be listed for both).
+ * @param outUserStates State for every user: Allow or Disallow.
+ * @param outGroups Names of groups defining the line.
+ * @param outGroupStates State for every group: Allow or Disallow.
+ * @return Success, Error
+ */
+extern "C" PLUGIN_API Status GetPermissionHolders(const plg::string& perm, plg::vector<uint64_t>& outUsers,
+                                                  plg::vector<PermSource>& outUserSources,
+                                                  plg::vector<Status>& outUserStates,
+                                                  plg::vector<plg::string>& outGroups,
+                                                  plg::vector<Status>& outGroupStates)
+{
+    outUsers.clear();
+    outUserSources.clear();
+    outUserStates.clear();
+    outGroups.clear();
+    outGroupStates.clear();
+    if (perm.empty())
+        return Status::Error;
+    std::string_view line = perm;
+    if (line.starts_with('-'))
+        line = line.substr(1);
+    SegmentIds ids;
+    g_SegmentTable.lookup(line, ids);
+
+    const plg::vector<PermHolder> holders = g_PermIndex.find(PermIndex::makeKey(ids.data(), ids.size()));
+    std::shared_lock lock(groups_mtx);
+    for (const PermHolder& h : holders)
+    {
+        const Status state = h.state ? Status::Allow : Status::Disallow;
+        if (h.source == PermSource::Group)
+        {
+            const auto it = groups.find(h.id);
+            if (it == groups.end())
+                continue;
+            outGroups.push_back(it->second->_name);
+            outGroupStates.push_back(state);
+        }
+        else
+        {
+            outUsers.push_back(h.id);
+            outUserSources.push_back(h.source);
+            outUserStates.push_back(state);
+        }
+    }
+    return Status::Success;
 }
 
 /**
@@ -792,9 +1145,7 @@ extern "C" PLUGIN_API plg::vector<uint64_t> DumpUsersList()
  */
 extern "C" PLUGIN_API void LoadUser(const int64_t pluginID, const uint64_t targetID, const plg::string& username, const bool offline, UserLoadedCallback callback)
 {
-    std::shared_lock lock2(user_load_callbacks._lock);
-    for (const UserRequestCallback cb : user_load_callbacks._callbacks)
-        cb(pluginID, targetID, username, offline, callback);
+    user_load_callbacks.invoke(pluginID, targetID, username, offline, callback);
 }
 
 // /**
@@ -810,9 +1161,7 @@ extern "C" PLUGIN_API void LoadUser(const int64_t pluginID, const uint64_t targe
 //  */
 // extern "C" PLUGIN_API void LoadedUser(const int64_t pluginID, const uint64_t targetID)
 // {
-//     std::shared_lock lock2(user_loaded_callbacks._lock);
-//     for (const UserLoadedCallback cb : user_loaded_callbacks._callbacks)
-//         cb(pluginID, targetID);
+//     user_loaded_callbacks.invoke(pluginID, targetID);
 // }
 
 /**
@@ -823,9 +1172,7 @@ extern "C" PLUGIN_API void LoadUser(const int64_t pluginID, const uint64_t targe
  */
 extern "C" PLUGIN_API Status OnLoadUser_Register(UserRequestCallback callback)
 {
-    std::unique_lock lock(user_load_callbacks._lock);
-    auto ret = user_load_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_load_callbacks.add(callback);
 }
 
 /**
@@ -836,9 +1183,7 @@ extern "C" PLUGIN_API Status OnLoadUser_Register(UserRequestCallback callback)
  */
 extern "C" PLUGIN_API Status OnLoadUser_Unregister(UserRequestCallback callback)
 {
-    std::unique_lock lock(user_load_callbacks._lock);
-    const size_t ret = user_load_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_load_callbacks.remove(callback);
 }
 
 // /**
@@ -849,9 +1194,7 @@ extern "C" PLUGIN_API Status OnLoadUser_Unregister(UserRequestCallback callback)
 //  */
 // extern "C" PLUGIN_API Status OnLoadedUser_Register(UserLoadedCallback callback)
 // {
-//     std::unique_lock lock(user_loaded_callbacks._lock);
-//     auto ret = user_loaded_callbacks._callbacks.insert(callback);
-//     return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+//     return user_loaded_callbacks.add(callback);
 // }
 //
 // /**
@@ -862,9 +1205,7 @@ extern "C" PLUGIN_API Status OnLoadUser_Unregister(UserRequestCallback callback)
 //  */
 // extern "C" PLUGIN_API Status OnLoadedUser_Unregister(UserLoadedCallback callback)
 // {
-//     std::unique_lock lock(user_loaded_callbacks._lock);
-//     const size_t ret = user_loaded_callbacks._callbacks.erase(callback);
-//     return ret > 0 ? Status::Success : Status::CallbackNotFound;
+//     return user_loaded_callbacks.remove(callback);
 // }
 
 /**
@@ -875,9 +1216,7 @@ extern "C" PLUGIN_API Status OnLoadUser_Unregister(UserRequestCallback callback)
  */
 extern "C" PLUGIN_API Status OnUserPermissionChange_Register(UserPermissionCallback callback)
 {
-    std::unique_lock lock(user_permission_callbacks._lock);
-    auto ret = user_permission_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_permission_callbacks.add(callback);
 }
 
 /**
@@ -888,9 +1227,7 @@ extern "C" PLUGIN_API Status OnUserPermissionChange_Register(UserPermissionCallb
  */
 extern "C" PLUGIN_API Status OnUserPermissionChange_Unregister(UserPermissionCallback callback)
 {
-    std::unique_lock lock(user_permission_callbacks._lock);
-    const size_t ret = user_permission_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_permission_callbacks.remove(callback);
 }
 
 /**
@@ -901,9 +1238,7 @@ extern "C" PLUGIN_API Status OnUserPermissionChange_Unregister(UserPermissionCal
  */
 extern "C" PLUGIN_API Status OnUserSetCookie_Register(UserSetCookieCallback callback)
 {
-    std::unique_lock lock(user_set_cookie_callbacks._lock);
-    auto ret = user_set_cookie_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_set_cookie_callbacks.add(callback);
 }
 
 /**
@@ -914,9 +1249,7 @@ extern "C" PLUGIN_API Status OnUserSetCookie_Register(UserSetCookieCallback call
  */
 extern "C" PLUGIN_API Status OnUserSetCookie_Unregister(UserSetCookieCallback callback)
 {
-    std::unique_lock lock(user_set_cookie_callbacks._lock);
-    const size_t ret = user_set_cookie_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_set_cookie_callbacks.remove(callback);
 }
 
 /**
@@ -927,9 +1260,7 @@ extern "C" PLUGIN_API Status OnUserSetCookie_Unregister(UserSetCookieCallback ca
  */
 extern "C" PLUGIN_API Status OnUserGroupChange_Register(UserGroupCallback callback)
 {
-    std::unique_lock lock(user_group_callbacks._lock);
-    auto ret = user_group_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_group_callbacks.add(callback);
 }
 
 /**
@@ -940,9 +1271,29 @@ extern "C" PLUGIN_API Status OnUserGroupChange_Register(UserGroupCallback callba
  */
 extern "C" PLUGIN_API Status OnUserGroupChange_Unregister(UserGroupCallback callback)
 {
-    std::unique_lock lock(user_group_callbacks._lock);
-    const size_t ret = user_group_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_group_callbacks.remove(callback);
+}
+
+/**
+ * @brief Register listener on batches of permission and group changes
+ *
+ * @param callback Function callback.
+ * @return
+ */
+extern "C" PLUGIN_API Status OnChangeBatch_Register(ChangeBatchCallback callback)
+{
+    return change_batch_callbacks.add(callback);
+}
+
+/**
+ * @brief Unregister listener on batches of permission and group changes
+ *
+ * @param callback Function callback.
+ * @return
+ */
+extern "C" PLUGIN_API Status OnChangeBatch_Unregister(ChangeBatchCallback callback)
+{
+    return change_batch_callbacks.remove(callback);
 }
 
 /**
@@ -953,9 +1304,7 @@ extern "C" PLUGIN_API Status OnUserGroupChange_Unregister(UserGroupCallback call
  */
 extern "C" PLUGIN_API Status OnUserCreate_Register(UserCreateCallback callback)
 {
-    std::unique_lock lock(user_create_callbacks._lock);
-    auto ret = user_create_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_create_callbacks.add(callback);
 }
 
 /**
@@ -966,9 +1315,7 @@ extern "C" PLUGIN_API Status OnUserCreate_Register(UserCreateCallback callback)
  */
 extern "C" PLUGIN_API Status OnUserCreate_Unregister(UserCreateCallback callback)
 {
-    std::unique_lock lock(user_create_callbacks._lock);
-    const size_t ret = user_create_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_create_callbacks.remove(callback);
 }
 
 /**
@@ -979,9 +1326,7 @@ extern "C" PLUGIN_API Status OnUserCreate_Unregister(UserCreateCallback callback
  */
 extern "C" PLUGIN_API Status OnUserDelete_Register(UserDeleteCallback callback)
 {
-    std::unique_lock lock(user_delete_callbacks._lock);
-    auto ret = user_delete_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return user_delete_callbacks.add(callback);
 }
 
 /**
@@ -992,9 +1337,7 @@ extern "C" PLUGIN_API Status OnUserDelete_Register(UserDeleteCallback callback)
  */
 extern "C" PLUGIN_API Status OnUserDelete_Unregister(UserDeleteCallback callback)
 {
-    std::unique_lock lock(user_delete_callbacks._lock);
-    const size_t ret = user_delete_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return user_delete_callbacks.remove(callback);
 }
 
 /**
@@ -1005,9 +1348,7 @@ extern "C" PLUGIN_API Status OnUserDelete_Unregister(UserDeleteCallback callback
  */
 extern "C" PLUGIN_API Status OnPermissionExpirationCallback_Register(PermExpirationCallback callback)
 {
-    std::unique_lock lock(perm_expiration_callbacks._lock);
-    auto ret = perm_expiration_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return perm_expiration_callbacks.add(callback);
 }
 
 /**
@@ -1018,9 +1359,7 @@ extern "C" PLUGIN_API Status OnPermissionExpirationCallback_Register(PermExpirat
  */
 extern "C" PLUGIN_API Status OnPermissionExpirationCallback_Unregister(PermExpirationCallback callback)
 {
-    std::unique_lock lock(perm_expiration_callbacks._lock);
-    const size_t ret = perm_expiration_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return perm_expiration_callbacks.remove(callback);
 }
 
 /**
@@ -1031,9 +1370,7 @@ extern "C" PLUGIN_API Status OnPermissionExpirationCallback_Unregister(PermExpir
  */
 extern "C" PLUGIN_API Status OnGroupExpirationCallback_Register(GroupExpirationCallback callback)
 {
-    std::unique_lock lock(group_expiration_callbacks._lock);
-    auto ret = group_expiration_callbacks._callbacks.insert(callback);
-    return ret.second ? Status::Success : Status::CallbackAlreadyExist;
+    return group_expiration_callbacks.add(callback);
 }
 
 /**
@@ -1044,9 +1381,7 @@ extern "C" PLUGIN_API Status OnGroupExpirationCallback_Register(GroupExpirationC
  */
 extern "C" PLUGIN_API Status OnGroupExpirationCallback_Unregister(GroupExpirationCallback callback)
 {
-    std::unique_lock lock(group_expiration_callbacks._lock);
-    const size_t ret = group_expiration_callbacks._callbacks.erase(callback);
-    return ret > 0 ? Status::Success : Status::CallbackNotFound;
+    return group_expiration_callbacks.remove(callback);
 }
 
 PLUGIFY_WARN_POP()
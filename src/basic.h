@@ -1,8 +1,12 @@
 #pragma once
 #include <mutex>
 #include <shared_mutex>
+#include <string_view>
 
-extern std::shared_mutex users_mtx, groups_mtx;
+#include <xxhash.h>
+#include <plg/string.hpp>
+
+extern std::shared_mutex groups_mtx;
 
 enum class Action : int32_t
 {
@@ -11,3 +15,39 @@ enum class Action : int32_t
     Replace = 2,
     ReplaceToWC = 3
 };
+
+enum class PermSource : uint32_t
+{
+    UserTemp = 0,
+    User = 1,
+    GroupTemp = 2,
+    Group = 3,
+    NotFound = 4,
+};
+
+// What a change record of ChangeBatchCallback describes
+enum class ChangeKind : int32_t
+{
+    UserPermission = 0,
+    GroupPermission = 1,
+    UserGroup = 2
+};
+
+struct string_hash
+{
+    using is_transparent = void; // Enables heterogeneous lookup
+
+    auto operator()(const plg::string& txt) const
+    {
+        if constexpr (sizeof(void*) == 8)
+            return XXH3_64bits(txt.data(), txt.size());
+        else return XXH32(txt.data(), txt.size(), 0);
+    }
+
+    auto operator()(const std::string_view& txt) const
+    {
+        if constexpr (sizeof(void*) == 8)
+            return XXH3_64bits(txt.data(), txt.size());
+        else return XXH32(txt.data(), txt.size(), 0);
+    }
+};
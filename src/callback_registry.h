@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include <plg/vector.hpp>
+
+#include "epoch.h"
+#include "node.h"
+#include "small_buffer.h"
+
+// Listeners of one event. They are kept in an immutable array which register and unregister replace
+// as a whole, so dispatch is a single acquire load without any lock. A listener unregistered during
+// dispatch may still get that one call. Listeners are called in order of registration.
+template<typename Callback>
+class CallbackRegistry {
+    using Listeners = plg::vector<Callback>;
+
+public:
+    CallbackRegistry() = default;
+    CallbackRegistry(const CallbackRegistry&) = delete;
+    CallbackRegistry& operator=(const CallbackRegistry&) = delete;
+
+    ~CallbackRegistry()
+    {
+        delete m_listeners.load(std::memory_order_relaxed);
+    }
+
+    // Success, CallbackAlreadyExist
+    Status add(const Callback callback)
+    {
+        std::scoped_lock lock(m_mutex);
+        const Listeners* old = m_listeners.load(std::memory_order_relaxed);
+        if (old && std::ranges::find(*old, callback) != old->end())
+            return Status::CallbackAlreadyExist;
+        auto* listeners = old ? new Listeners(*old) : new Listeners;
+        listeners->push_back(callback);
+        publish(listeners);
+        return Status::Success;
+    }
+
+    // Success, CallbackNotFound
+    Status remove(const Callback callback)
+    {
+        std::scoped_lock lock(m_mutex);
+        const Listeners* old = m_listeners.load(std::memory_order_relaxed);
+        if (old == nullptr || std::ranges::find(*old, callback) == old->end())
+            return Status::CallbackNotFound;
+        Listeners* listeners = nullptr;
+        if (old->size() > 1)
+        {
+            listeners = new Listeners;
+            for (const Callback cb : *old)
+                if (cb != callback)
+                    listeners->push_back(cb);
+        }
+        publish(listeners);
+        return Status::Success;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_listeners.load(std::memory_order_relaxed) == nullptr;
+    }
+
+    // Call every listener with args. The epoch is pinned only while the listeners are copied out,
+    // so a slow listener doesn't hold back reclamation of anything retired meanwhile.
+    template<typename... Args>
+    void invoke(const Args&... args) const
+    {
+        if (empty())
+            return;
+        SmallBuffer<Callback, 8> callbacks;
+        {
+            EpochGuard guard;
+            if (const Listeners* listeners = m_listeners.load(std::memory_order_acquire))
+                for (const Callback cb : *listeners)
+                    callbacks.push_back(cb);
+        }
+        for (const Callback cb : callbacks)
+            cb(args...);
+    }
+
+private:
+    void publish(const Listeners* listeners)
+    {
+        if (const Listeners* old = m_listeners.exchange(listeners, std::memory_order_acq_rel))
+            g_Epoch.retire(old);
+        g_Epoch.collectBatch();
+    }
+
+    std::atomic<const Listeners*> m_listeners{}; // nullptr without listeners
+    std::mutex m_mutex; // serializes register and unregister
+};
@@ -0,0 +1,278 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <parallel_hashmap/phmap.h>
+#include <plg/config.hpp>
+
+#include "node_arena.h"
+
+// Nested nodes of a trie node keyed by segment id, stored according to their count:
+// nothing is allocated for a leaf, a few children live in one small sorted array
+// and only nodes with more than SmallLimit children get a hash map.
+// All memory comes from the arena of the tree, which is passed to every mutating call.
+// Destructor doesn't free anything - the tree is released together with its arena.
+// T keeps its own nested nodes in member `nodes`.
+template<typename T>
+class ChildMap {
+public:
+    using Entry = std::pair<uint32_t, T>;
+    using Map = phmap::flat_hash_map<uint32_t, T, phmap::Hash<uint32_t>, phmap::EqualTo<uint32_t>,
+                                     ArenaAllocator<std::pair<const uint32_t, T>>>;
+    static constexpr uint32_t SmallLimit = 8;
+
+    ChildMap() = default;
+    ChildMap(const ChildMap&) = delete;
+    ChildMap& operator=(const ChildMap&) = delete;
+
+    ChildMap(ChildMap&& other) noexcept : m_small(other.m_small), m_size(other.m_size), m_capacity(other.m_capacity)
+    {
+        other.m_small = nullptr;
+        other.m_size = other.m_capacity = 0;
+    }
+
+    // Target must be empty (moved from or cleared), its memory isn't returned to arena
+    ChildMap& operator=(ChildMap&& other) noexcept
+    {
+        if (this != &other)
+        {
+            m_small = std::exchange(other.m_small, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_capacity = std::exchange(other.m_capacity, 0);
+        }
+        return *this;
+    }
+
+    ~ChildMap() = default;
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t size() const
+    {
+        return isMap() ? static_cast<uint32_t>(m_map->size()) : m_size;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool empty() const
+    {
+        return size() == 0;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE T* find(const uint32_t id)
+    {
+        return const_cast<T*>(std::as_const(*this).find(id));
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const T* find(const uint32_t id) const
+    {
+        if (isMap())
+        {
+            const auto it = m_map->find(id);
+            return it == m_map->end() ? nullptr : &it->second;
+        }
+        for (uint32_t i = 0; i < m_size; ++i)
+            if (m_small[i].first == id)
+                return &m_small[i].second;
+        return nullptr;
+    }
+
+    // Nested node by id, default constructed if missing. Pointers to other children are invalidated.
+    T& try_emplace(const uint32_t id, NodeArena& arena)
+    {
+        if (isMap())
+            return m_map->try_emplace(id).first->second;
+
+        Entry* pos = lowerBound(id);
+        if (pos != m_small + m_size && pos->first == id)
+            return pos->second;
+        if (m_size == SmallLimit)
+        {
+            toMap(arena);
+            return m_map->try_emplace(id).first->second;
+        }
+        if (m_size == m_capacity)
+        {
+            reallocate(m_capacity == 0 ? 1 : std::min(m_capacity * 2, SmallLimit), arena);
+            pos = lowerBound(id);
+        }
+
+        Entry* end = m_small + m_size;
+        if (pos == end)
+            std::construct_at(end, id, T{});
+        else
+        {
+            std::construct_at(end, std::move(end[-1]));
+            std::move_backward(pos, end - 1, end);
+            *pos = Entry(id, T{});
+        }
+        ++m_size;
+        return pos->second;
+    }
+
+    // Remove nested node together with its subtree
+    bool erase(const uint32_t id, NodeArena& arena)
+    {
+        if (isMap())
+        {
+            const auto it = m_map->find(id);
+            if (it == m_map->end())
+                return false;
+            it->second.nodes.clear(arena);
+            m_map->erase(it);
+            if (m_map->size() <= SmallLimit / 2)
+                toSmall(arena);
+            return true;
+        }
+        Entry* pos = lowerBound(id);
+        Entry* end = m_small + m_size;
+        if (pos == end || pos->first != id)
+            return false;
+        pos->second.nodes.clear(arena);
+        std::move(pos + 1, end, pos);
+        std::destroy_at(end - 1);
+        if (--m_size == 0)
+            clear(arena);
+        return true;
+    }
+
+    // Remove all nested nodes with their subtrees and return memory to arena
+    void clear(NodeArena& arena)
+    {
+        forEach([&arena](uint32_t, T& child) { child.nodes.clear(arena); });
+        if (isMap())
+        {
+            std::destroy_at(m_map);
+            arena.deallocate(m_map, sizeof(Map));
+        }
+        else if (m_small)
+        {
+            std::destroy_n(m_small, m_size);
+            arena.deallocate(m_small, m_capacity * sizeof(Entry));
+        }
+        m_small = nullptr;
+        m_size = m_capacity = 0;
+    }
+
+    // Copy nested nodes of other into this empty map, T copies its fields and subtree in T::copyFrom
+    void copyFrom(const ChildMap& other, NodeArena& arena)
+    {
+        other.forEach([this, &arena](const uint32_t id, const T& child) { try_emplace(id, arena).copyFrom(child, arena); });
+    }
+
+    // Move all storage of the subtree to another arena with no spare capacity.
+    // Nothing is returned to the old arena, it is meant to be released afterwards.
+    void relocate(NodeArena& to)
+    {
+        if (isMap())
+        {
+            NodeArena::State* state = to.state();
+            Map* map = new (state->allocate(sizeof(Map))) Map(0, phmap::Hash<uint32_t>(), phmap::EqualTo<uint32_t>(),
+                                                              ArenaAllocator<std::pair<const uint32_t, T>>(state));
+            map->reserve(m_map->size());
+            for (auto& [id, child] : *m_map)
+                map->emplace(id, std::move(child));
+            m_map = map;
+        }
+        else if (m_small)
+        {
+            auto* small = static_cast<Entry*>(to.allocate(m_size * sizeof(Entry)));
+            std::uninitialized_move_n(m_small, m_size, small);
+            m_small = small;
+            m_capacity = m_size;
+        }
+        forEach([&to](uint32_t, T& child) { child.nodes.relocate(to); });
+    }
+
+    // fn(id, child) for every nested node, small arrays are visited in order of segment id
+    template<typename F>
+    void forEach(F&& fn)
+    {
+        if (isMap())
+        {
+            for (auto& [id, child] : *m_map)
+                fn(id, child);
+            return;
+        }
+        for (uint32_t i = 0; i < m_size; ++i)
+            fn(m_small[i].first, m_small[i].second);
+    }
+
+    template<typename F>
+    void forEach(F&& fn) const
+    {
+        if (isMap())
+        {
+            for (const auto& [id, child] : *m_map)
+                fn(id, child);
+            return;
+        }
+        for (uint32_t i = 0; i < m_size; ++i)
+            fn(m_small[i].first, std::as_const(m_small[i].second));
+    }
+
+private:
+    static constexpr uint32_t MapMode = 0xFFFFFFFF; // m_capacity value while children are in hash map
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool isMap() const
+    {
+        return m_capacity == MapMode;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Entry* lowerBound(const uint32_t id) const
+    {
+        return std::lower_bound(m_small, m_small + m_size, id,
+                                [](const Entry& e, const uint32_t key) { return e.first < key; });
+    }
+
+    void reallocate(const uint32_t capacity, NodeArena& arena)
+    {
+        static_assert(alignof(Entry) <= NodeArena::Alignment, "arena blocks are not aligned enough");
+        auto* small = static_cast<Entry*>(arena.allocate(capacity * sizeof(Entry)));
+        if (m_small)
+        {
+            std::uninitialized_move_n(m_small, m_size, small);
+            std::destroy_n(m_small, m_size);
+            arena.deallocate(m_small, m_capacity * sizeof(Entry));
+        }
+        m_small = small;
+        m_capacity = capacity;
+    }
+
+    void toMap(NodeArena& arena)
+    {
+        NodeArena::State* state = arena.state();
+        Map* map = new (state->allocate(sizeof(Map))) Map(0, phmap::Hash<uint32_t>(), phmap::EqualTo<uint32_t>(),
+                                                          ArenaAllocator<std::pair<const uint32_t, T>>(state));
+        map->reserve(SmallLimit + 1);
+        for (uint32_t i = 0; i < m_size; ++i)
+            map->emplace(m_small[i].first, std::move(m_small[i].second));
+        std::destroy_n(m_small, m_size);
+        arena.deallocate(m_small, m_capacity * sizeof(Entry));
+        m_map = map;
+        m_size = 0;
+        m_capacity = MapMode;
+    }
+
+    void toSmall(NodeArena& arena)
+    {
+        Map* map = m_map;
+        const uint32_t size = static_cast<uint32_t>(map->size());
+        auto* small = static_cast<Entry*>(arena.allocate(size * sizeof(Entry)));
+        uint32_t i = 0;
+        for (auto& [id, child] : *map)
+            std::construct_at(small + i++, id, std::move(child));
+        std::sort(small, small + size, [](const Entry& a, const Entry& b) { return a.first < b.first; });
+        std::destroy_at(map);
+        arena.deallocate(map, sizeof(Map));
+        m_small = small;
+        m_size = m_capacity = size;
+    }
+
+    union
+    {
+        Entry* m_small{}; // sorted by segment id
+        Map* m_map;
+    };
+    uint32_t m_size{}; // used entries of m_small
+    uint32_t m_capacity{}; // allocated entries of m_small, MapMode with hash map
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <parallel_hashmap/phmap.h>
+#include <xxhash.h>
+#include <plg/vector.hpp>
+
+#include "effective_trie.h"
+#include "perm_registry.h"
+
+// Effective tries shared by users whose checks go through the same trees: same groups in the same order
+// and the same own lines (own trees share compiled tries through g_NodePool) or none at all.
+// A trie is found by ids of the compiled tries it merges, so users with equal inputs get one trie
+// however their stamps differ, and it is freed with its last user. Trees without any line are left out
+// of the key and of the merge, they never give a result. Results of indexed registered permissions are
+// evaluated once per trie too; a trie which misses permissions registered since is rebuilt by the next
+// user refreshed onto it, the users still on it check those permissions in the trie.
+class EffectivePool {
+    static constexpr size_t SweepBatch = 64; // entries kept before expired ones are swept
+
+    struct Entry
+    {
+        plg::vector<uint64_t> inputs; // per source: content id of compiled trie, source and timestamps flag
+        std::weak_ptr<const EffectiveTrie> trie;
+    };
+
+    EffectivePool() = default;
+    ~EffectivePool() = default;
+
+public:
+    EffectivePool(const EffectivePool&) = delete;
+    static auto& Instance() {
+        static EffectivePool instance;
+        return instance;
+    }
+
+    // Trie merging sources, built only if no live and fully indexed trie merges the same trees
+    std::shared_ptr<const EffectiveTrie> acquire(const plg::vector<EffectiveSource>& sources)
+    {
+        plg::vector<EffectiveSource> used;
+        plg::vector<uint64_t> inputs;
+        for (const EffectiveSource& src : sources)
+        {
+            const CompiledTrie& trie = *src.trie;
+            if (trie.nodes.size() == 1 && !trie.nodes[0].wildcard)
+                continue;
+            used.push_back(src);
+            inputs.push_back(trie.content_id << 8 | static_cast<uint64_t>(src.source) << 1 | src.timestamps);
+        }
+        const uint64_t key = XXH3_64bits(inputs.data(), inputs.size() * sizeof(uint64_t));
+
+        {
+            std::scoped_lock lock(m_mutex);
+            if (std::shared_ptr<const EffectiveTrie> trie = find(key, inputs))
+                return trie;
+        }
+
+        // Built without the lock, users refreshed in other shards meanwhile may build the same trie
+        auto* built = new EffectiveTrie; // not make_shared: expired entries keep only the control block
+        built->build(used);
+        built->bits.update(0, g_PermRegistry.indexedCount(), [built](const uint32_t bit) {
+            const RegisteredPerm* rp = g_PermRegistry.get(bit);
+            PermSource perm_type;
+            bool w_wildcard;
+            time_t w_timestamp;
+            return built->_hasPermission(rp->ids.data(), rp->user_sz, perm_type, false, w_wildcard, w_timestamp);
+        });
+        std::shared_ptr<const EffectiveTrie> trie(built);
+
+        std::shared_ptr<const EffectiveTrie> other;
+        {
+            std::scoped_lock lock(m_mutex);
+            other = find(key, inputs);
+            if (!other)
+            {
+                if (m_tries.size() >= m_sweep_at)
+                {
+                    for (auto it = m_tries.begin(); it != m_tries.end();)
+                    {
+                        if (it->second.trie.expired())
+                            m_tries.erase(it++);
+                        else
+                            ++it;
+                    }
+                    m_sweep_at = std::max(SweepBatch, m_tries.size() * 2);
+                }
+                m_tries[key] = {std::move(inputs), trie};
+            }
+        }
+        return other ? other : trie;
+    }
+
+private:
+    [[nodiscard]] std::shared_ptr<const EffectiveTrie> find(const uint64_t key,
+                                                            const plg::vector<uint64_t>& inputs) const
+    {
+        const auto it = m_tries.find(key);
+        if (it == m_tries.end() || it->second.inputs != inputs)
+            return nullptr;
+        std::shared_ptr<const EffectiveTrie> trie = it->second.trie.lock();
+        if (trie && trie->bits.size < g_PermRegistry.indexedCount())
+            return nullptr;
+        return trie;
+    }
+
+    phmap::flat_hash_map<uint64_t, Entry> m_tries; // by hash of inputs
+    size_t m_sweep_at{SweepBatch};
+    std::mutex m_mutex;
+};
+inline EffectivePool& g_EffectivePool = EffectivePool::Instance();
@@ -0,0 +1,213 @@
+#pragma once
+#include "perm_bits.h"
+#include "perm_tree.h"
+#include "path_filter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+#include <plg/vector.hpp>
+
+// Result of a permission check packed into one word: timestamp | wildcard | source | status.
+// Timestamp -1 means lookup didn't touch timestamp.
+constexpr uint64_t packResult(const Status status, const PermSource perm_type, const bool w_wildcard,
+                              const time_t w_timestamp)
+{
+    return static_cast<uint64_t>(w_timestamp) << 8 | static_cast<uint64_t>(w_wildcard) << 7 |
+           static_cast<uint64_t>(perm_type) << 4 | static_cast<uint64_t>(status);
+}
+
+PLUGIFY_FORCE_INLINE Status unpackResult(const uint64_t data, PermSource& perm_type, bool& w_wildcard,
+                                         time_t& w_timestamp)
+{
+    perm_type = static_cast<PermSource>((data >> 4) & 0x7);
+    w_wildcard = (data >> 7) & 0x1;
+    const time_t timestamp = static_cast<time_t>(static_cast<int64_t>(data) >> 8);
+    if (timestamp != -1)
+        w_timestamp = timestamp;
+    return static_cast<Status>(data & 0xF);
+}
+
+constexpr uint64_t NotFoundResult = packResult(Status::PermNotFound, PermSource::NotFound, false, -1);
+
+// One input of the effective trie, sources are checked in the order they are passed to build()
+struct EffectiveSource
+{
+    const CompiledTrie* trie;
+    PermSource source;
+    bool timestamps; // group trees don't report timestamps
+};
+
+struct EffectiveNode
+{
+    uint32_t first; // index of first nested node
+    uint32_t count; // number of nested nodes
+    uint64_t exact; // result of exact check which ends at this node
+    uint64_t loose; // result of non-exact check which ends at this node
+    uint64_t below; // result of non-exact check which leaves the trie below this node
+};
+
+// Union of all trees which affect permissions of a user (temporary, own, groups with their parents)
+// with the winning result precomputed for every node, so a check is a single descent.
+// Layout follows CompiledTrie: BFS order, nested nodes contiguous and sorted by segment id.
+struct EffectiveTrie
+{
+    plg::vector<uint32_t> keys;
+    plg::vector<EffectiveNode> nodes;
+    uint64_t star{NotFoundResult}; // result of "*" check
+    PathFilter filter; // paths of nodes which give a result in any source
+    PermBits bits; // indexed registered permissions of users, filled by g_EffectivePool (groups keep their own)
+    uint64_t stamp{}; // hash of inputs trie was built from
+    uint32_t generation{}; // new for every build, so results cached by generation never mix two tries
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermission(const uint32_t ids[], const int sz, PermSource& perm_type,
+                                                             const bool exact, bool& w_wildcard,
+                                                             time_t& w_timestamp) const
+    {
+        if (sz == 0)
+            return unpackResult(NotFoundResult, perm_type, w_wildcard, w_timestamp);
+        const bool l_wildcard = ids[sz - 1] == AllAccess;
+        if (sz == 1 && l_wildcard)
+            return unpackResult(star, perm_type, w_wildcard, w_timestamp);
+
+        const int counter = l_wildcard ? sz - 1 : sz;
+        uint32_t current = 0;
+        for (int i = 0; i < counter; ++i)
+        {
+            const uint32_t idx = child(current, ids[i]);
+            if (idx == SegmentNotFound)
+                return unpackResult(result(current, false, exact), perm_type, w_wildcard, w_timestamp);
+            current = idx;
+        }
+        return unpackResult(result(current, true, exact), perm_type, w_wildcard, w_timestamp);
+    }
+
+    // Nested node of node by segment id, SegmentNotFound if missing
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t child(const uint32_t node, const uint32_t id) const
+    {
+        return findSegment(keys.data(), nodes[node].first, nodes[node].count, id);
+    }
+
+    // Packed result of a check which ended at node (complete) or left the trie below it
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint64_t result(const uint32_t node, const bool complete, const bool exact) const
+    {
+        if (!complete)
+            return exact ? NotFoundResult : nodes[node].below;
+        return exact ? nodes[node].exact : nodes[node].loose;
+    }
+
+    void build(const plg::vector<EffectiveSource>& sources)
+    {
+        const size_t k = sources.size();
+        keys.clear();
+        nodes.clear();
+        plg::vector<Cursor> cursors;
+        cursors.reserve(k);
+
+        plg::vector<uint64_t> paths; // filter key of every node
+        plg::vector<uint64_t> marked; // filter keys of nodes which are end or wildcard in some source
+
+        star = NotFoundResult;
+        bool root_marked = false;
+        for (const EffectiveSource& src : sources)
+        {
+            const CompiledNode& root = src.trie->nodes[0];
+            if (star == NotFoundResult && root.wildcard)
+                star = packResult(root.state ? Status::Allow : Status::Disallow, src.source, true, -1);
+            root_marked |= root.wildcard; // root is an end node of every tree, but only "*" answers from it
+            cursors.push_back({0, root.wildcard ? 0 : SegmentNotFound});
+        }
+        keys.push_back(0);
+        nodes.push_back(resolve(sources, cursors.data()));
+        paths.push_back(PathFilter::RootKey);
+        if (root_marked)
+            marked.push_back(PathFilter::RootKey);
+
+        plg::vector<std::tuple<uint32_t, uint32_t, uint32_t>> children; // segment id, source, nested node
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            children.clear();
+            for (size_t s = 0; s < k; ++s)
+            {
+                const uint32_t cur = cursors[i * k + s].node;
+                if (cur == SegmentNotFound)
+                    continue;
+                const CompiledNode& node = sources[s].trie->nodes[cur];
+                for (uint32_t c = node.first; c < node.first + node.count; ++c)
+                    children.emplace_back(sources[s].trie->keys[c], static_cast<uint32_t>(s), c);
+            }
+            std::ranges::sort(children);
+
+            nodes[i].first = static_cast<uint32_t>(nodes.size());
+            nodes[i].count = 0;
+            for (size_t j = 0; j < children.size();)
+            {
+                const uint32_t id = std::get<0>(children[j]);
+                const size_t base = cursors.size();
+                for (size_t s = 0; s < k; ++s)
+                    cursors.push_back({SegmentNotFound, cursors[i * k + s].wild});
+                bool node_marked = false;
+                for (; j < children.size() && std::get<0>(children[j]) == id; ++j)
+                {
+                    const auto [_, s, c] = children[j];
+                    Cursor& cursor = cursors[base + s];
+                    const CompiledNode& node = sources[s].trie->nodes[c];
+                    cursor.node = c;
+                    if (node.wildcard)
+                        cursor.wild = c;
+                    node_marked |= node.wildcard || node.end_node;
+                }
+                keys.push_back(id);
+                nodes.push_back(resolve(sources, cursors.data() + base));
+                paths.push_back(PathFilter::extend(paths[i], string_hash{}(g_SegmentTable.name(id))));
+                if (node_marked)
+                    marked.push_back(paths.back());
+                ++nodes[i].count;
+            }
+        }
+        filter.build(marked);
+        static std::atomic<uint32_t> last_generation{};
+        generation = last_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+private:
+    // Position of a path in one source: node at the end of path (if path exists there)
+    // and the deepest wildcard node on its existing part
+    struct Cursor
+    {
+        uint32_t node;
+        uint32_t wild;
+    };
+
+    // Pick the first source which answers each kind of check, same as checking sources one by one
+    static EffectiveNode resolve(const plg::vector<EffectiveSource>& sources, const Cursor* cursors)
+    {
+        EffectiveNode result{0, 0, NotFoundResult, NotFoundResult, NotFoundResult};
+        for (size_t s = 0; s < sources.size(); ++s)
+        {
+            const EffectiveSource& src = sources[s];
+            const Cursor& cursor = cursors[s];
+            const CompiledNode* node = cursor.node != SegmentNotFound ? &src.trie->nodes[cursor.node] : nullptr;
+            const CompiledNode* wild = cursor.wild != SegmentNotFound ? &src.trie->nodes[cursor.wild] : nullptr;
+
+            if (node && node->end_node)
+            {
+                const uint64_t end = packResult(node->state ? Status::Allow : Status::Disallow, src.source,
+                                                node->wildcard, src.timestamps ? node->timestamp : -1);
+                if (result.exact == NotFoundResult)
+                    result.exact = end;
+                if (result.loose == NotFoundResult)
+                    result.loose = end;
+            }
+            else if (wild && result.loose == NotFoundResult)
+            {
+                // Timestamp of wildcard is reported only when the path itself exists in the tree
+                result.loose = packResult(wild->state ? Status::Allow : Status::Disallow, src.source, true,
+                                          node && src.timestamps ? wild->timestamp : -1);
+            }
+            if (wild && result.below == NotFoundResult)
+                result.below = packResult(wild->state ? Status::Allow : Status::Disallow, src.source, true, -1);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+
+#include <plg/vector.hpp>
+
+// Epoch-based reclamation for structures read without locks.
+// A reader pins the current epoch for the time of one call (EpochGuard), writers unlink old versions
+// and retire them; a retired object is destroyed once every reader which could have seen it has left.
+// Readers only write their own slot, so they never share a cache line with each other or with writers.
+class EpochManager {
+    static constexpr uint64_t Idle = std::numeric_limits<uint64_t>::max();
+    static constexpr size_t CollectBatch = 64; // retired objects kept before writers try to free them
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{Idle}; // epoch pinned by reader, Idle outside of reads
+        std::atomic<bool> used{}; // owned by a live thread
+        Slot* next{};
+    };
+
+    // Slot of the calling thread, given back when the thread exits
+    struct ThreadSlot
+    {
+        Slot* slot{};
+        uint32_t depth{}; // nested guards
+
+        ~ThreadSlot()
+        {
+            if (slot)
+                slot->used.store(false, std::memory_order_release);
+        }
+    };
+
+    struct Retired
+    {
+        const void* ptr;
+        void (*destroy)(const void*);
+        uint64_t epoch; // epoch when ptr was unlinked
+    };
+
+    EpochManager() = default;
+    ~EpochManager()
+    {
+        for (const Retired& r : m_retired)
+            r.destroy(r.ptr);
+        for (Slot* slot = m_slots.load(std::memory_order_acquire); slot;)
+        {
+            Slot* next = slot->next;
+            delete slot;
+            slot = next;
+        }
+    }
+
+public:
+    EpochManager(const EpochManager&) = delete;
+    static auto& Instance() {
+        static EpochManager instance;
+        return instance;
+    }
+
+    void enter()
+    {
+        ThreadSlot& ts = threadSlot();
+        if (ts.depth++ != 0)
+            return;
+        ts.slot->epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        // Writers scanning slots see the pin before this thread reads anything published
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void leave()
+    {
+        ThreadSlot& ts = threadSlot();
+        if (--ts.depth == 0)
+            ts.slot->epoch.store(Idle, std::memory_order_release);
+    }
+
+    // Destroy ptr once no reader can reach it anymore, ptr must already be unlinked from every published structure
+    template<typename T>
+    void retire(const T* ptr)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_retired.push_back({ptr, [](const void* p) { delete static_cast<const T*>(p); },
+                             m_epoch.fetch_add(1, std::memory_order_seq_cst)});
+    }
+
+    // Destroy retired objects no reader can see. Destructors run on the calling thread without any lock held here,
+    // retired objects synchronize whatever they share themselves (users release shared nodes under pool mutex).
+    void collect()
+    {
+        plg::vector<Retired> ready;
+        {
+            std::scoped_lock lock(m_mutex);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t oldest = Idle;
+            for (const Slot* slot = m_slots.load(std::memory_order_acquire); slot; slot = slot->next)
+                oldest = std::min(oldest, slot->epoch.load(std::memory_order_acquire));
+
+            size_t kept = 0;
+            for (const Retired& r : m_retired)
+            {
+                if (r.epoch < oldest)
+                    ready.push_back(r);
+                else
+                    m_retired[kept++] = r;
+            }
+            m_retired.resize(kept);
+            m_collect_at = std::max(CollectBatch, kept * 2);
+        }
+        for (const Retired& r : ready)
+            r.destroy(r.ptr);
+    }
+
+    // collect() if enough objects are waiting, for writers after they retire something.
+    // Objects still pinned by readers raise the bar, so a long read doesn't make every writer rescan them.
+    void collectBatch()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            if (m_retired.size() < m_collect_at)
+                return;
+        }
+        collect();
+    }
+
+private:
+    ThreadSlot& threadSlot()
+    {
+        thread_local ThreadSlot ts;
+        if (ts.slot == nullptr)
+            ts.slot = acquireSlot();
+        return ts;
+    }
+
+    // Reuse a slot of an exited thread or add a new one, slots are never freed while the manager lives
+    Slot* acquireSlot()
+    {
+        for (Slot* slot = m_slots.load(std::memory_order_acquire); slot; slot = slot->next)
+        {
+            bool used = false;
+            if (!slot->used.load(std::memory_order_relaxed) &&
+                slot->used.compare_exchange_strong(used, true, std::memory_order_acquire))
+                return slot;
+        }
+        auto* slot = new Slot;
+        slot->used.store(true, std::memory_order_relaxed);
+        slot->next = m_slots.load(std::memory_order_relaxed);
+        while (!m_slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return slot;
+    }
+
+    std::atomic<uint64_t> m_epoch{1};
+    std::atomic<Slot*> m_slots{nullptr}; // slots of all threads that ever read, newest first
+    plg::vector<Retired> m_retired;
+    size_t m_collect_at{CollectBatch}; // size of m_retired which triggers collectBatch
+    std::mutex m_mutex; // guards m_retired and m_collect_at
+};
+inline EpochManager& g_Epoch = EpochManager::Instance();
+
+// Pins current epoch for the lifetime of the guard: published versions read meanwhile stay alive
+class EpochGuard {
+public:
+    EpochGuard() { g_Epoch.enter(); }
+    ~EpochGuard() { g_Epoch.leave(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <variant>
+
+#include <plg/any.hpp>
+#include <plg/string.hpp>
+#include <plg/vector.hpp>
+
+#include "basic.h"
+#include "node.h"
+
+struct User;
+struct Group;
+
+// Change events, one per listener call. Fields follow arguments of the matching callback type.
+struct UserPermissionEvent
+{
+    int64_t pluginID;
+    Action action;
+    uint64_t targetID;
+    plg::string perm;
+    Status oldState;
+    Status newState;
+    time_t oldTimestamp;
+    time_t newTimestamp;
+};
+
+struct UserSetCookieEvent
+{
+    int64_t pluginID;
+    uint64_t targetID;
+    plg::string name;
+    plg::any cookie;
+};
+
+struct UserGroupEvent
+{
+    int64_t pluginID;
+    Action action;
+    uint64_t targetID;
+    plg::string group;
+    time_t oldTimestamp;
+    time_t newTimestamp;
+};
+
+struct UserCreateEvent
+{
+    int64_t pluginID;
+    uint64_t targetID;
+    int immunity;
+    bool offline;
+    plg::vector<plg::string> groupNames;
+};
+
+struct UserDeleteEvent
+{
+    int64_t pluginID;
+    uint64_t targetID;
+    const User* user; // erased from users, readable by the listeners and retired after them
+};
+
+struct PermExpirationEvent
+{
+    uint64_t targetID;
+    plg::string perm;
+    Status state;
+    time_t timestamp; // of the expired grant, for batch listeners
+};
+
+struct GroupExpirationEvent
+{
+    uint64_t targetID;
+    plg::string group;
+    time_t timestamp; // of the expired grant, for batch listeners
+};
+
+struct SetParentEvent
+{
+    int64_t pluginID;
+    plg::string childName;
+    plg::string parentName;
+};
+
+struct SetOptionGroupEvent
+{
+    int64_t pluginID;
+    plg::string groupName;
+    plg::string optionName;
+    plg::any value;
+};
+
+struct GroupPermissionEvent
+{
+    int64_t pluginID;
+    Action action;
+    plg::string groupName;
+    plg::string perm;
+    Status oldState;
+    Status newState;
+};
+
+struct GroupCreateEvent
+{
+    int64_t pluginID;
+    plg::string name;
+    plg::vector<plg::string> perms;
+    int priority;
+    plg::string parent;
+};
+
+struct GroupDeleteEvent
+{
+    int64_t pluginID;
+    plg::string name;
+    const Group* group; // erased from groups, readable by the listeners and retired after them
+};
+
+using Event = std::variant<UserPermissionEvent, UserSetCookieEvent, UserGroupEvent, UserCreateEvent, UserDeleteEvent,
+                           PermExpirationEvent, GroupExpirationEvent, SetParentEvent, SetOptionGroupEvent,
+                           GroupPermissionEvent, GroupCreateEvent, GroupDeleteEvent>;
+
+// Call listeners of one event, defined next to the listener sets (user_manager.cpp, group_manager.cpp)
+void DispatchEvent(const UserPermissionEvent& e);
+void DispatchEvent(const UserSetCookieEvent& e);
+void DispatchEvent(const UserGroupEvent& e);
+void DispatchEvent(const UserCreateEvent& e);
+void DispatchEvent(const UserDeleteEvent& e);
+void DispatchEvent(const PermExpirationEvent& e);
+void DispatchEvent(const GroupExpirationEvent& e);
+void DispatchEvent(const SetParentEvent& e);
+void DispatchEvent(const SetOptionGroupEvent& e);
+void DispatchEvent(const GroupPermissionEvent& e);
+void DispatchEvent(const GroupCreateEvent& e);
+void DispatchEvent(const GroupDeleteEvent& e);
+
+// Call batch listeners with permission and group changes among events, after their own listeners got them
+void DispatchBatch(const plg::vector<Event>& events);
+
+// Change events waiting for their listeners. Mutators record events while they still hold the lock of
+// the changed user or groups, so events of one user or group are queued in the order of changes, and return
+// without waiting for listeners. Events are dispatched in the same order by drain() on plugin update,
+// with no users or groups lock held, so slow listeners never delay permission checks.
+class EventQueue {
+    EventQueue() = default;
+    ~EventQueue() = default;
+
+public:
+    EventQueue(const EventQueue&) = delete;
+    static auto& Instance() {
+        static EventQueue instance;
+        return instance;
+    }
+
+    void push(Event&& event)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_events.push_back(std::move(event));
+    }
+
+    // Dispatch events queued so far, one by one and then as a batch.
+    // Events recorded by listeners meanwhile wait for the next drain.
+    void drain()
+    {
+        std::scoped_lock lock(m_drain_mutex);
+        plg::vector<Event> events;
+        {
+            std::scoped_lock lock2(m_mutex);
+            events.swap(m_events);
+        }
+        for (const Event& event : events)
+            std::visit([](const auto& e) { DispatchEvent(e); }, event);
+        DispatchBatch(events);
+    }
+
+private:
+    plg::vector<Event> m_events;
+    std::mutex m_mutex; // guards m_events
+    std::mutex m_drain_mutex; // keeps dispatch in order if several threads drain
+};
+inline EventQueue& g_EventQueue = EventQueue::Instance();
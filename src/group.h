@@ -1,5 +1,10 @@
 #pragma once
-#include "node.h"
+#include "effective_trie.h"
+#include "epoch.h"
+#include "perm_bits.h"
+#include "perm_registry.h"
+
+#include <atomic>
 
 #include <xxhash.h>
 #include <parallel_hashmap/phmap.h>
@@ -7,56 +12,159 @@
 #include <plg/string.hpp>
 #include <plg/vector.hpp>
 
+// Contents of a group at one point in time. A published version is never changed: edits publish a changed copy
+// and the old one is destroyed after readers leave, so users and lookups read it without locks.
+struct GroupVersion
+{
+    phmap::flat_hash_map<plg::string, plg::any, string_hash, std::equal_to<>> options; // group options aka cookies on user
+    PermTree nodes; // nodes of group
+    EffectiveTrie resolved; // own permissions merged with all parents, child overrides parent
+    PermBits bits; // indexed registered permissions, including parents
+
+    [[nodiscard]] Status hasPermission(std::string_view perm, const bool exact, bool& w_wildcard) const
+    {
+    	if (perm.starts_with('-'))
+    		perm = perm.substr(1);
+        PermTokens tokens;
+        tokenize(perm, tokens, false);
+        if (!resolved.filter.mayMatch(tokens))
+        {
+            w_wildcard = false;
+            return Status::PermNotFound;
+        }
+        SegmentIds ids;
+        g_SegmentTable.resolve(tokens, ids);
+
+        return _hasPermission(ids.data(), static_cast<int>(ids.size()), exact, w_wildcard);
+    }
+
+    // Single descent of resolved trie, same result as checking this group and then its parents one by one
+    Status _hasPermission(const uint32_t ids[], const int sz, const bool exact, bool& w_wildcard) const
+    {
+        PermSource perm_type;
+        time_t _timestamp;
+        return resolved._hasPermission(ids, sz, perm_type, exact, w_wildcard, _timestamp);
+    }
+};
+
 struct Group
 {
-    Group* _parent; // root of this group
+    std::atomic<Group*> _parent; // root of this group, walked by user reads without locks
     plg::string _name; // name of group
     int _priority; // priority of group
-    phmap::flat_hash_map<plg::string, plg::any, string_hash, std::equal_to<>> options; // group options aka cookies on user
-    Node _nodes; // nodes of group
+    std::atomic<const GroupVersion*> _version; // current contents
 
     Group(const plg::vector<plg::string>& perms, const plg::string& name, const int priority, Group* parent = nullptr)
     {
         this->_name = name;
         this->_parent = parent;
         this->_priority = priority;
-        this->_nodes = {phmap::flat_hash_map<plg::string, Node, string_hash>(), 0xFFFFFFFF, false, false, true, 0};
-        for (const plg::string& perm: perms)
-            this->_nodes.addPerm(perm);
-        Node::forceRehash(this->_nodes.nodes);
+        auto* version = new GroupVersion;
+        version->nodes.owner_id = XXH3_64bits(name.data(), name.size());
+        version->nodes.owner_source = PermSource::Group;
+        version->nodes.addPerms(perms);
+        resolve(*version);
+        this->_version = version;
     }
 
-    [[nodiscard]] Status hasPermission(std::string_view perm, const bool exact, bool& w_wildcard) const
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+
+    ~Group()
     {
-    	if (perm.starts_with('-'))
-    		perm = perm.substr(1);
-        auto ispl = std::views::split(perm, '.');
-        uint64_t hashes[256];
-        std::string_view names[256];
-        int i = 0;
-        for (auto&& s : ispl)
-        {
-            const auto ptr = s.empty() ? nullptr : &*s.begin();
-            const auto len = s.size();
-            hashes[i] = XXH3_64bits(ptr, len);
-            names[i] = std::string_view(ptr, len);
-            ++i;
-        }
+        delete _version.load(std::memory_order_relaxed);
+    }
 
-        return _hasPermission(names, hashes, i, exact, w_wildcard);
+    // Published contents, valid while the caller holds an EpochGuard or groups_mtx (versions are replaced only
+    // under exclusive groups lock)
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const GroupVersion& current() const
+    {
+        return *_version.load(std::memory_order_acquire);
+    }
+
+    // Copy of contents to change and publish(), groups_mtx must be held exclusively
+    [[nodiscard]] GroupVersion* edit() const
+    {
+        return new GroupVersion(current());
     }
 
-    Status _hasPermission(const std::string_view names[], const uint64_t hashes[], const int sz, const bool exact, bool& w_wildcard) const
+    // Make a changed copy the current version, the old one is retired. Resolved trie is rebuilt if the tree
+    // of group changed. Must be called under exclusive groups lock.
+    void publish(GroupVersion* version)
     {
-        const Group* i = this;
+        if (version->nodes.generation != current().nodes.generation)
+            resolve(*version);
+        replace(version);
+    }
 
-        while (i)
+    // Hash trees of this group and all its parents into stamp, and add them to sources if given.
+    // Every group of the chain is read once, so stamp describes exactly the trees which were added,
+    // even if the chain is edited meanwhile. Caller holds an EpochGuard.
+    uint64_t collect(uint64_t stamp, plg::vector<EffectiveSource>* sources, const PermSource source) const
+    {
+        for (const Group* g = this; g; g = g->_parent.load(std::memory_order_acquire))
         {
-            time_t _timestamp;
-            Status temp = i->_nodes._hasPermission(names, hashes, sz, exact, w_wildcard, _timestamp);
-            if (temp == Status::PermNotFound) i = i->_parent;
-            else return temp;
+            const GroupVersion& version = g->current();
+            stamp = mix(g, version.nodes.generation, stamp);
+            if (sources)
+                sources->push_back({&version.nodes.compiled, source, false});
         }
-        return Status::PermNotFound;
+        return stamp;
+    }
+
+    // Rebuild resolved trie if this group or any of its parents changed, must be called under exclusive groups lock
+    void refresh()
+    {
+        EpochGuard guard;
+        const GroupVersion& old = current();
+        if (collect(0, nullptr, PermSource::Group) == old.resolved.stamp && !old.resolved.nodes.empty())
+            return;
+        GroupVersion* version = edit();
+        resolve(*version);
+        replace(version);
+    }
+
+    // Evaluate indexed registered permissions starting from bit, must be called under exclusive groups lock
+    void updateBits(const uint32_t from)
+    {
+        GroupVersion* version = edit();
+        updateBits(*version, from);
+        replace(version);
+    }
+
+private:
+    [[nodiscard]] static uint64_t mix(const Group* g, const uint32_t generation, const uint64_t stamp)
+    {
+        const uint64_t part[2] = {reinterpret_cast<uintptr_t>(g), generation};
+        return XXH3_64bits_withSeed(part, sizeof(part), stamp);
+    }
+
+    // Merge own tree of version (not published yet) with current trees of all parents
+    void resolve(GroupVersion& version) const
+    {
+        EpochGuard guard;
+        plg::vector<EffectiveSource> sources;
+        sources.push_back({&version.nodes.compiled, PermSource::Group, false});
+        uint64_t stamp = mix(this, version.nodes.generation, 0);
+        if (const Group* parent = _parent.load(std::memory_order_acquire))
+            stamp = parent->collect(stamp, &sources, PermSource::Group);
+        version.resolved.build(sources);
+        version.resolved.stamp = stamp;
+        updateBits(version, 0);
+    }
+
+    static void updateBits(GroupVersion& version, const uint32_t from)
+    {
+        version.bits.update(from, g_PermRegistry.indexedCount(), [&version](const uint32_t bit) {
+            const RegisteredPerm* rp = g_PermRegistry.get(bit);
+            bool w_wildcard;
+            return version._hasPermission(rp->ids.data(), static_cast<int>(rp->ids.size()), false, w_wildcard);
+        });
+    }
+
+    void replace(const GroupVersion* version)
+    {
+        g_Epoch.retire(_version.exchange(version, std::memory_order_acq_rel));
+        g_Epoch.collectBatch();
     }
 };
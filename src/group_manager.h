@@ -1,5 +1,7 @@
 #pragma once
 #include "basic.h"
+#include "callback_registry.h"
+#include "event_queue.h"
 #include "group.h"
 #include "user_manager.h"
 
@@ -8,15 +10,67 @@
 
 extern phmap::flat_hash_map<uint64_t, Group*> groups;
 
-PLUGIFY_FORCE_INLINE Group* GetGroup(const std::string_view& name)
+// Group by its key in groups (hash of name), groups_mtx must be held by the caller
+PLUGIFY_FORCE_INLINE Group* FindGroupByHash(const uint64_t hash)
 {
-    const uint64_t hash = XXH3_64bits(name.data(), name.size());
-    std::shared_lock lock(groups_mtx);
     const auto it = groups.find(hash);
     if (it == groups.end()) return nullptr;
     return it->second;
 }
 
+// Group by name, groups_mtx must be held by the caller
+PLUGIFY_FORCE_INLINE Group* FindGroup(const std::string_view& name)
+{
+    return FindGroupByHash(XXH3_64bits(name.data(), name.size()));
+}
+
+PLUGIFY_FORCE_INLINE Group* GetGroup(const std::string_view& name)
+{
+    std::shared_lock lock(groups_mtx);
+    return FindGroup(name);
+}
+
+// Group erased from groups whose delete listeners run on this thread, see DepartedGroupScope
+struct DepartedGroup
+{
+    uint64_t hash{};
+    const Group* group{};
+};
+
+inline DepartedGroup& DepartedGroupSlot()
+{
+    thread_local DepartedGroup d;
+    return d;
+}
+
+// Makes a deleted group visible to ViewGroupByHash on this thread for the lifetime of the scope
+class DepartedGroupScope {
+public:
+    DepartedGroupScope(const uint64_t hash, const Group* group) { DepartedGroupSlot() = {hash, group}; }
+    ~DepartedGroupScope() { DepartedGroupSlot() = {}; }
+    DepartedGroupScope(const DepartedGroupScope&) = delete;
+    DepartedGroupScope& operator=(const DepartedGroupScope&) = delete;
+};
+
+// Group for a read by its key in groups. Same as FindGroupByHash, except that listeners of a group's deletion
+// still see the deleted group on the thread which runs them, unless a new one took its name.
+// Changes look groups up in groups directly, so they never touch a deleted group. groups_mtx must be held by the caller
+PLUGIFY_FORCE_INLINE const Group* ViewGroupByHash(const uint64_t hash)
+{
+    if (const Group* group = FindGroupByHash(hash))
+        return group;
+    const DepartedGroup& d = DepartedGroupSlot();
+    return d.group != nullptr && d.hash == hash ? d.group : nullptr;
+}
+
+// Rebuild resolved tries (and indexed permissions) of groups affected by a change in group permissions
+// or hierarchy, i.e. the changed group and all groups inheriting from it. groups_mtx must be held exclusively
+inline void RefreshGroups()
+{
+    for (Group* g : groups | std::views::values)
+        g->refresh();
+}
+
 /**
  * @brief Callback invoked when a parent group is set for a child group.
  *
@@ -85,44 +139,9 @@ using GroupDeleteCallback = void (*)(const int64_t pluginID, const plg::string&
 using LoadGroupsCallback = void(*)(const int64_t pluginID);
 
 
-struct SetParentCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<SetParentCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct SetOptionGroupCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<SetOptionGroupCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct GroupPermissionCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<GroupPermissionCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct GroupCreateCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<GroupCreateCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct GroupDeleteCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<GroupDeleteCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct LoadGroupsCallbacks
-{
-	std::shared_mutex _lock;
-	phmap::flat_hash_set<LoadGroupsCallback> _callbacks;
-	std::atomic_int _counter;
-};
+using SetParentCallbacks = CallbackRegistry<SetParentCallback>;
+using SetOptionGroupCallbacks = CallbackRegistry<SetOptionGroupCallback>;
+using GroupPermissionCallbacks = CallbackRegistry<GroupPermissionCallback>;
+using GroupCreateCallbacks = CallbackRegistry<GroupCreateCallback>;
+using GroupDeleteCallbacks = CallbackRegistry<GroupDeleteCallback>;
+using LoadGroupsCallbacks = CallbackRegistry<LoadGroupsCallback>;
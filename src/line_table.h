@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+
+#include <parallel_hashmap/phmap.h>
+#include <plg/string.hpp>
+
+#include "basic.h"
+
+// Global table of whole permission lines of temporary permissions, so their timers keep just an id.
+// Kept apart from g_SegmentTable: bursts of temporary grants neither grow segment lookups nor take
+// the segment table's unique lock. Lines are never removed, ids stay valid for pending timers.
+class LineTable {
+    LineTable() = default;
+    ~LineTable() = default;
+
+public:
+    LineTable(const LineTable&) = delete;
+    static auto& Instance() {
+        static LineTable instance;
+        return instance;
+    }
+
+    uint32_t intern(const std::string_view line)
+    {
+        {
+            std::shared_lock lock(m_mutex);
+            const auto it = m_ids.find(line);
+            if (it != m_ids.end())
+                return it->second;
+        }
+        std::unique_lock lock(m_mutex);
+        const auto [it, inserted] = m_ids.try_emplace(plg::string(line), static_cast<uint32_t>(m_lines.size()));
+        if (inserted)
+            m_lines.push_back(it->first);
+        return it->second;
+    }
+
+    [[nodiscard]] std::string_view line(const uint32_t id) const
+    {
+        std::shared_lock lock(m_mutex);
+        return m_lines[id];
+    }
+
+private:
+    phmap::flat_hash_map<plg::string, uint32_t, string_hash, std::equal_to<>> m_ids;
+    std::deque<plg::string> m_lines; // deque keeps stored strings in place on growth
+    mutable std::shared_mutex m_mutex;
+};
+inline LineTable& g_LineTable = LineTable::Instance();
@@ -1,19 +1,16 @@
 #pragma once
 #include <string_view>
 #include <ranges>
-#include <stack>
 
 #include <parallel_hashmap/phmap.h>
 #include <xxhash.h>
 #include <plg/string.hpp>
 #include <plg/vector.hpp>
 
+#include "child_map.h"
+#include "segment_table.h"
 #include "timer_system.h"
 
-const uint64_t AllAccess = XXH3_64bits("*", 1);
-
-extern void g_PermExpirationCallback([[maybe_unused]] uint32_t timer, const plg::vector<plg::any>& userData);
-
 enum class Status : int32_t
 {
     Success = 0,
@@ -38,25 +35,6 @@ enum class Status : int32_t
 	Error = 18
 };
 
-struct string_hash
-{
-    using is_transparent = void; // Enables heterogeneous lookup
-
-    auto operator()(const plg::string& txt) const
-    {
-        if constexpr (sizeof(void*) == 8)
-            return XXH3_64bits(txt.data(), txt.size());
-        else return XXH32(txt.data(), txt.size(), 0);
-    }
-
-    auto operator()(const std::string_view& txt) const
-    {
-        if constexpr (sizeof(void*) == 8)
-            return XXH3_64bits(txt.data(), txt.size());
-        else return XXH32(txt.data(), txt.size(), 0);
-    }
-};
-
 PLUGIFY_FORCE_INLINE bool isWildcard(std::string_view perm)
 {
     if (perm.starts_with('-'))
@@ -85,103 +63,47 @@ PLUGIFY_FORCE_INLINE void parseTempString(const std::string_view& input, std::st
 
 struct Node
 {
-    phmap::flat_hash_map<plg::string, Node, string_hash> nodes; // nested nodes
-    uint32_t timer; // timer id for temporal perms
-    bool wildcard; // skip all nested nodes
-    bool state; // indicates permission status (Allow/Disallow)
-    bool end_node; // indicates non-intermediate node
-    time_t timestamp;
-
-    PLUGIFY_FORCE_INLINE Status _hasPermission(const std::string_view names[], const uint64_t hashes[],
-                                               const int sz, const bool exact, bool& w_wildcard,
-                                               time_t& w_timestamp) const
+    ChildMap<Node> nodes; // nested nodes, keyed by segment id
+    uint32_t timer{0xFFFFFFFF}; // timer id for temporal perms
+    bool wildcard{}; // skip all nested nodes
+    bool state{}; // indicates permission status (Allow/Disallow)
+    bool end_node{}; // indicates non-intermediate node
+    time_t timestamp{};
+
+    // Copy flags and subtree of other into this leaf, nested nodes are allocated from arena
+    void copyFrom(const Node& other, NodeArena& arena)
     {
-        w_wildcard = false;
-        const bool l_wildcard = hashes[sz - 1] == AllAccess;
-        const int counter = l_wildcard ? sz - 1 : sz;
-        if (sz == 1 && l_wildcard)
-        {
-            if (this->wildcard)
-            {
-                w_wildcard = true;
-                return this->state ? Status::Allow : Status::Disallow;
-            }
-            return Status::PermNotFound;
-        }
-        const Node* current = this;
-        const Node* lastWild = wildcard ? this : nullptr; // save last wildcard position
-
-        for (int i = 0; i < counter; ++i)
-        {
-            auto it = current->nodes.find(names[i], hashes[i]);
-            if (it == current->nodes.end())
-            {
-                if (exact)
-                    return Status::PermNotFound;
-                // requested node not found - return wildcard status
-                w_wildcard = lastWild != nullptr;
-                return lastWild ? (lastWild->state ? Status::Allow : Status::Disallow) : Status::PermNotFound;
-            }
-
-            // save current position
-            current = &it->second;
-            // save last wildcard position
-            if (current->wildcard) lastWild = current;
-        }
-
-        // Check non-intermediate node
-        if (current->end_node)
-        {
-            w_wildcard = current->wildcard;
-            w_timestamp = current->timestamp;
-            return current->state ? Status::Allow : Status::Disallow;
-        }
-
-        // Node found, but isn't marked as end - MR64 forgot to clean dead nodes
-        if (exact)
-            return Status::PermNotFound;
-        if (lastWild)
-        {
-            w_wildcard = true;
-            w_timestamp = lastWild->timestamp;
-            return lastWild->state ? Status::Allow : Status::Disallow;
-        }
-        return Status::PermNotFound;
+        timer = other.timer;
+        wildcard = other.wildcard;
+        state = other.state;
+        end_node = other.end_node;
+        timestamp = other.timestamp;
+        nodes.copyFrom(other.nodes, arena);
     }
 
     PLUGIFY_FORCE_INLINE bool deletePerm(std::string_view perm, const bool recursive_delete,
-                                         plg::vector<plg::string>& deleted_perms)
+                                         plg::vector<plg::string>& deleted_perms, NodeArena& arena)
     {
         if (perm.starts_with('-'))
             perm = perm.substr(1);
-        auto ispl = std::views::split(perm, '.');
-        uint64_t hashes[256];
-        std::string_view names[256];
-        int i = 0;
-        for (const auto&& s : ispl)
-        {
-            hashes[i] = XXH3_64bits(s.data(), s.size());
-            names[i] = std::string_view(s);
-            ++i;
-            if (hashes[i - 1] == AllAccess)
-                break;
-        }
+        SegmentIds ids;
+        g_SegmentTable.lookup(perm, ids);
         // deleted_perms.clear();
-        return this->deletePerm(names, hashes, i, recursive_delete, deleted_perms);
+        return this->deletePerm(ids.data(), static_cast<int>(ids.size()), recursive_delete, deleted_perms, arena);
     }
 
-    PLUGIFY_FORCE_INLINE bool deletePerm(const std::string_view names[], const uint64_t hashes[], const int sz,
-                                         const bool recursive_delete, plg::vector<plg::string>& deleted_perms)
+    PLUGIFY_FORCE_INLINE bool deletePerm(const uint32_t ids[], const int sz, const bool recursive_delete,
+                                         plg::vector<plg::string>& deleted_perms, NodeArena& arena)
     {
         if (sz < 1) return false;
 
-        const bool hasWildcard = hashes[sz - 1] == AllAccess;
+        const bool hasWildcard = ids[sz - 1] == AllAccess;
         const int counter = sz - 1;
         int count = 0;
         Node* curNode = this;
-        std::pair<Node*, int> ancestors[256];
+        SmallBuffer<Node*, 16> ancestors; // nodes on the path, ancestors[i] holds nested node ids[i]
 
-        if (hashes[0] == AllAccess)
+        if (ids[0] == AllAccess)
         {
             if (!curNode->wildcard)
                 return false;
@@ -197,7 +119,7 @@ struct Node
             {
                 deleted_perms = dumpNode(*curNode, false);
                 destroyAllTimers(*curNode);
-                curNode->nodes.clear();
+                curNode->nodes.clear(arena);
             }
             else
                 deleted_perms.push_back("*");
@@ -210,39 +132,38 @@ struct Node
         // find pre-last element
         for (int i = 0; i < counter; ++i)
         {
-            const auto it = curNode->nodes.find(names[i], hashes[i]);
-            if (it == curNode->nodes.end()) return false;
+            Node* next = curNode->nodes.find(ids[i]);
+            if (next == nullptr) return false;
 
-            ancestors[count] = {curNode, count};
+            ancestors.push_back(curNode);
             ++count;
-            curNode = &it->second;
+            curNode = next;
         }
 
         Node* nodeReset = curNode;
 
         if (!hasWildcard)
         {
-            const auto it = curNode->nodes.find(names[counter], hashes[counter]);
-            if (it == curNode->nodes.end()) return false; // Node not found
-        	ancestors[count] = {curNode, count};
+            nodeReset = curNode->nodes.find(ids[counter]);
+            if (nodeReset == nullptr) return false; // Node not found
+        	ancestors.push_back(curNode);
         	++count;
-            nodeReset = &it->second;
         }
 
     	if (!nodeReset->end_node || nodeReset->wildcard != hasWildcard)
     		return false; // Mark as "Not found"
 
-        plg::string base_name = names[0];
+        plg::string base_name(g_SegmentTable.name(ids[0]));
         {
             for (int i = 1; i < counter; ++i)
             {
                 base_name += '.';
-                base_name += names[i];
+                base_name += g_SegmentTable.name(ids[i]);
             }
 			if (!hasWildcard)
             {
                 base_name += '.';
-                base_name += names[counter];
+                base_name += g_SegmentTable.name(ids[counter]);
             }
 			else if (!recursive_delete)
         		base_name += ".*";
@@ -251,7 +172,7 @@ struct Node
         {
             dumpNodes(base_name, *nodeReset, deleted_perms);
             destroyAllTimers(*nodeReset);
-            nodeReset->nodes.clear();
+            nodeReset->nodes.clear(arena);
         }
         else
         {
@@ -278,35 +199,32 @@ struct Node
         // Delete empty nodes
         for (int i = (count - 1); i >= 0; --i)
         {
-            Node* parent = ancestors[i].first;
-            const auto it = parent->nodes.find(names[ancestors[i].second], hashes[ancestors[i].second]);
-            if (it != parent->nodes.end())
-                parent->nodes.erase(it);
+            Node* parent = ancestors[static_cast<uint32_t>(i)];
+            parent->nodes.erase(ids[i], arena);
             if (parent->end_node || !parent->nodes.empty()) // This node have state - stop
                 break;
         }
         return true;
     }
 
-    PLUGIFY_FORCE_INLINE Node* addPerm(std::string_view perm)
+    PLUGIFY_FORCE_INLINE Node* addPerm(std::string_view perm, NodeArena& arena)
     {
         const bool allow = !perm.starts_with('-');
         bool hasWildcard = false;
-        auto spl = std::views::split(perm, '.');
+        PermTokens tokens;
+        tokenize(perm, tokens, false);
 
         Node* node = this;
-        for (auto&& s : spl)
+        for (const PermToken& token : tokens)
         {
-            auto ss = std::string_view(s);
+            auto ss = token.name();
             if (ss.starts_with('-')) ss = ss.substr(1);
             if (ss == "*")
             {
                 hasWildcard = true;
                 break;
             }
-            node = &(node->nodes.try_emplace(plg::string(ss), phmap::flat_hash_map<plg::string, Node, string_hash>(),
-                                             0xFFFFFFFF,
-                                             false, false, false, 0).first->second);
+            node = &node->nodes.try_emplace(g_SegmentTable.intern(ss), arena);
         }
         node->state = allow;
         node->wildcard = hasWildcard;
@@ -322,29 +240,12 @@ struct Node
             g_TimerSystem.KillTimer(node.timer);
             node.timer = 0xFFFFFFFF;
         }
-        for (auto& val : node.nodes | std::views::values)
-            destroyAllTimers(val);
-    }
-
-    PLUGIFY_FORCE_INLINE static void forceRehash(phmap::flat_hash_map<plg::string, Node, string_hash>& nodes)
-    {
-        // nodes.rehash(0);
-        // for (std::pair<const plg::string, Node>& n : nodes) forceRehash(n.second.nodes);
-        std::stack<phmap::flat_hash_map<plg::string, Node, string_hash>*> stack;
-        stack.push(&nodes);
-        while (!stack.empty())
-        {
-            auto* cur = stack.top();
-            stack.pop();
-
-            cur->rehash(0);
-
-            for (auto& v : *cur | std::views::values)
-                stack.push(&v.nodes);
-        }
+        node.nodes.forEach([](uint32_t, Node& val) { destroyAllTimers(val); });
     }
 
-    inline static void dumpNodes(const plg::string& base_name, const Node& root,
+    // Lines of a node tree, N is Node or SharedNode
+    template<typename N>
+    inline static void dumpNodes(const plg::string& base_name, const N& root,
                                  plg::vector<plg::string>& output_perms, const bool preserve_state = true)
     {
         if (root.end_node)
@@ -359,10 +260,15 @@ struct Node
                 s += " " + plg::to_string(root.timestamp);
             output_perms.push_back(std::move(s));
         }
-        for (const auto& [key, val] : root.nodes) dumpNodes(base_name + "." + key, val, output_perms);
+        root.nodes.forEach([&](const uint32_t key, const N& val) {
+            plg::string name = base_name + ".";
+            name += g_SegmentTable.name(key);
+            dumpNodes(name, val, output_perms);
+        });
     }
 
-    PLUGIFY_FORCE_INLINE static plg::vector<plg::string> dumpNode(const Node& root_node,
+    template<typename N>
+    PLUGIFY_FORCE_INLINE static plg::vector<plg::string> dumpNode(const N& root_node,
                                                                   const bool preserve_state = true)
     {
         plg::vector<plg::string> perms;
@@ -373,7 +279,9 @@ struct Node
                 s += " " + plg::to_string(root_node.timestamp);
             perms.push_back(s);
         }
-        for (const auto& [key, val] : root_node.nodes) dumpNodes(key, val, perms, preserve_state);
+        root_node.nodes.forEach([&](const uint32_t key, const N& val) {
+            dumpNodes(plg::string(g_SegmentTable.name(key)), val, perms, preserve_state);
+        });
 
         return perms;
     }
@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <plg/config.hpp>
+
+// Memory of one permission tree. Blocks are carved from a few growing chunks, freed blocks are kept
+// for reuse by allocations of the same size, and the whole tree is released at once by freeing its chunks,
+// without visiting nodes. All state lives in the first chunk, so the arena handle can move together
+// with its owner while allocators given out by state() stay valid.
+class NodeArena {
+    static constexpr size_t Granularity = 8;
+    static constexpr size_t FirstChunk = 512;
+    static constexpr size_t MaxChunk = 64 * 1024;
+    static constexpr uint32_t FreeListScan = 8; // blocks looked at before falling back to a fresh one
+
+    struct Chunk
+    {
+        Chunk* next;
+        size_t size;
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+        size_t size;
+    };
+
+public:
+    static constexpr size_t Alignment = Granularity;
+
+    struct State
+    {
+        Chunk* chunks;
+        char* cur;
+        char* end;
+        FreeBlock* free; // freed blocks, most recent first
+        size_t next_chunk; // size of next chunk
+        size_t reserved; // bytes of all chunks
+        size_t live; // bytes of blocks in use
+
+        void* allocate(size_t size)
+        {
+            size = blockSize(size);
+            live += size;
+            FreeBlock** link = &free;
+            for (uint32_t i = 0; *link && i < FreeListScan; ++i, link = &(*link)->next)
+            {
+                if ((*link)->size == size)
+                    return std::exchange(*link, (*link)->next);
+            }
+
+            if (static_cast<size_t>(end - cur) < size)
+            {
+                addChunk(std::max(next_chunk, size + sizeof(Chunk)));
+                next_chunk = std::min(next_chunk * 2, MaxChunk);
+            }
+            return std::exchange(cur, cur + size);
+        }
+
+        void deallocate(void* p, size_t size)
+        {
+            size = blockSize(size);
+            live -= size;
+            free = new (p) FreeBlock{free, size};
+        }
+
+        void addChunk(const size_t size)
+        {
+            auto* chunk = static_cast<Chunk*>(::operator new(size));
+            chunk->next = chunks;
+            chunk->size = size;
+            chunks = chunk;
+            reserved += size;
+            cur = reinterpret_cast<char*>(chunk) + sizeof(Chunk);
+            end = reinterpret_cast<char*>(chunk) + size;
+        }
+    };
+    static_assert(sizeof(Chunk) % Granularity == 0 && sizeof(State) % Granularity == 0);
+
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+    NodeArena(NodeArena&& other) noexcept : m_state(std::exchange(other.m_state, nullptr)) {}
+
+    NodeArena& operator=(NodeArena&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            m_state = std::exchange(other.m_state, nullptr);
+        }
+        return *this;
+    }
+
+    ~NodeArena()
+    {
+        release();
+    }
+
+    // State for allocators, created on first use
+    [[nodiscard]] State* state()
+    {
+        if (m_state == nullptr)
+            create(FirstChunk);
+        return m_state;
+    }
+
+    // Make room for size bytes of blocks in one chunk
+    void reserve(const size_t size)
+    {
+        if (m_state == nullptr)
+            create(sizeof(Chunk) + sizeof(State) + size);
+        else if (static_cast<size_t>(m_state->end - m_state->cur) < size)
+            m_state->addChunk(sizeof(Chunk) + size);
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE void* allocate(const size_t size)
+    {
+        return state()->allocate(size);
+    }
+
+    PLUGIFY_FORCE_INLINE void deallocate(void* p, const size_t size)
+    {
+        m_state->deallocate(p, size);
+    }
+
+    // Free all blocks at once. Objects placed in the arena are not destroyed.
+    void release()
+    {
+        if (m_state == nullptr)
+            return;
+        for (Chunk* chunk = m_state->chunks; chunk;)
+        {
+            Chunk* next = chunk->next;
+            ::operator delete(chunk, chunk->size);
+            chunk = next;
+        }
+        m_state = nullptr;
+    }
+
+    // Bytes taken from the global allocator
+    [[nodiscard]] size_t reserved() const
+    {
+        return m_state ? m_state->reserved : 0;
+    }
+
+    // Bytes of blocks in use
+    [[nodiscard]] size_t live() const
+    {
+        return m_state ? m_state->live : 0;
+    }
+
+    // Most of reserved memory is unused, worth moving live blocks to a new arena
+    [[nodiscard]] bool sparse() const
+    {
+        return m_state && m_state->reserved > FirstChunk * 2 &&
+               m_state->reserved > m_state->live + m_state->live / 2;
+    }
+
+private:
+    void create(const size_t size)
+    {
+        auto* chunk = static_cast<Chunk*>(::operator new(size));
+        chunk->next = nullptr;
+        chunk->size = size;
+        m_state = new (reinterpret_cast<char*>(chunk) + sizeof(Chunk)) State{};
+        m_state->chunks = chunk;
+        m_state->cur = reinterpret_cast<char*>(m_state) + sizeof(State);
+        m_state->end = reinterpret_cast<char*>(chunk) + size;
+        m_state->next_chunk = FirstChunk;
+        m_state->reserved = size;
+    }
+
+    // Bytes actually taken by a block, big enough to hold a free list entry
+    [[nodiscard]] static constexpr size_t blockSize(const size_t size)
+    {
+        return std::max((size + Granularity - 1) & ~(Granularity - 1), sizeof(FreeBlock));
+    }
+
+    State* m_state{};
+};
+
+// Allocator handing out arena blocks, for containers placed inside arena
+template<typename T>
+struct ArenaAllocator
+{
+    static_assert(alignof(T) <= NodeArena::Alignment, "arena blocks are not aligned enough");
+
+    using value_type = T;
+
+    NodeArena::State* state;
+
+    explicit ArenaAllocator(NodeArena::State* s) : state(s) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : state(other.state) {}
+
+    T* allocate(const size_t n)
+    {
+        return static_cast<T*>(state->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, const size_t n)
+    {
+        state->deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return state == other.state;
+    }
+};
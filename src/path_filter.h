@@ -0,0 +1,65 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+#include <plg/vector.hpp>
+
+#include "tokenizer.h"
+
+// Blocked Bloom filter over paths of trie nodes which can give a result (end nodes and wildcards).
+// Path key chains hashes of segments, so a line is probed right after tokenizing, without resolving segment ids.
+// If no prefix of a line hits the filter, the trie answers PermNotFound for it.
+class PathFilter {
+public:
+    static constexpr uint64_t RootKey = 0x9E3779B97F4A7C15ull;
+
+    [[nodiscard]] static constexpr uint64_t extend(uint64_t key, const size_t segment_hash)
+    {
+        key = std::rotl(key, 31) ^ static_cast<uint64_t>(segment_hash);
+        key *= 0xBF58476D1CE4E5B9ull;
+        return key ^ (key >> 29);
+    }
+
+    // Roughly 16 bits per key, two bits per key set inside one word
+    void build(const plg::vector<uint64_t>& keys)
+    {
+        m_words.assign(std::bit_ceil(keys.size() / 4 + 1), 0);
+        m_mask = m_words.size() - 1;
+        for (const uint64_t key : keys)
+            m_words[(key >> 32) & m_mask] |= bits(key);
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool mayContain(const uint64_t key) const
+    {
+        const uint64_t b = bits(key);
+        return (m_words[(key >> 32) & m_mask] & b) == b;
+    }
+
+    // False if the line certainly doesn't reach any end node or wildcard.
+    // Trailing "*" is not a part of the path, same as in trie lookups.
+    [[nodiscard]] bool mayMatch(const PermTokens& tokens) const
+    {
+        uint32_t counter = tokens.size();
+        if (counter != 0 && tokens[counter - 1].isWildcard())
+            --counter;
+        uint64_t key = RootKey;
+        if (mayContain(key))
+            return true;
+        for (uint32_t i = 0; i < counter; ++i)
+        {
+            key = extend(key, tokens[i].hash);
+            if (mayContain(key))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    [[nodiscard]] PLUGIFY_FORCE_INLINE static uint64_t bits(const uint64_t key)
+    {
+        return 1ull << (key & 63) | 1ull << ((key >> 6) & 63);
+    }
+
+    plg::vector<uint64_t> m_words = plg::vector<uint64_t>(1, 0); // empty filter, nothing matches
+    uint64_t m_mask{};
+};
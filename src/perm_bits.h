@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <plg/vector.hpp>
+
+#include "node.h"
+
+// Precomputed results of indexed registered permissions for one user or group.
+// Bit i of allow/deny holds the result of permission handle i, so a check is a single bit test
+// and checks of many permissions are word-wide ANDs.
+struct PermBits
+{
+    plg::vector<uint64_t> allow;
+    plg::vector<uint64_t> deny;
+    uint32_t size{}; // number of evaluated bits, handles past it fall back to trie
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool contains(const uint32_t bit) const
+    {
+        return bit < size;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status test(const uint32_t bit) const
+    {
+        const uint64_t mask = 1ull << (bit & 63);
+        if (allow[bit >> 6] & mask)
+            return Status::Allow;
+        if (deny[bit >> 6] & mask)
+            return Status::Disallow;
+        return Status::PermNotFound;
+    }
+
+    // Evaluate bits [from, count) with fn(bit) -> Status
+    template<typename F>
+    void update(const uint32_t from, const uint32_t count, F&& fn)
+    {
+        allow.resize((count + 63) / 64);
+        deny.resize((count + 63) / 64);
+        for (uint32_t bit = from; bit < count; ++bit)
+        {
+            const uint64_t mask = 1ull << (bit & 63);
+            allow[bit >> 6] &= ~mask;
+            deny[bit >> 6] &= ~mask;
+            const Status status = fn(bit);
+            if (status == Status::Allow)
+                allow[bit >> 6] |= mask;
+            else if (status == Status::Disallow)
+                deny[bit >> 6] |= mask;
+        }
+        size = count;
+    }
+};
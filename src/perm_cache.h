@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Small direct-mapped cache of permission check results.
+// Readers fill it concurrently without any lock, so every slot stores its key xor-ed with the value:
+// a torn slot fails the check and is treated as a miss. Generation is mixed into the key by the caller,
+// so bumping it makes all old entries unreachable without clearing anything.
+class PermCache {
+    static constexpr uint32_t Slots = 64;
+
+    struct Slot {
+        std::atomic<uint64_t> check{};
+        std::atomic<uint64_t> data{};
+    };
+
+public:
+    PermCache() = default;
+    // Copy of a user starts with an empty cache, its results are cached again on use
+    PermCache(const PermCache&) : PermCache() {}
+    PermCache(PermCache&& other) noexcept : m_slots(other.m_slots.exchange(nullptr, std::memory_order_relaxed)) {}
+    PermCache& operator=(PermCache&& other) noexcept
+    {
+        delete[] m_slots.exchange(other.m_slots.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+    ~PermCache()
+    {
+        delete[] m_slots.load(std::memory_order_relaxed);
+    }
+
+    static constexpr uint64_t makeKey(const uint64_t perm_hash, const bool exact, const uint64_t generation)
+    {
+        return perm_hash ^ (generation * 0x9E3779B97F4A7C15ull) ^ (exact ? 0xD6E8FEB86659FD93ull : 0);
+    }
+
+    [[nodiscard]] bool find(const uint64_t key, uint64_t& data) const
+    {
+        const Slot* slots = m_slots.load(std::memory_order_acquire);
+        if (slots == nullptr)
+            return false;
+        const Slot& slot = slots[key & (Slots - 1)];
+        data = slot.data.load(std::memory_order_relaxed);
+        return (slot.check.load(std::memory_order_relaxed) ^ data) == key;
+    }
+
+    void store(const uint64_t key, const uint64_t data) const
+    {
+        Slot* slots = m_slots.load(std::memory_order_acquire);
+        if (slots == nullptr)
+        {
+            // Allocated on first store - most offline users are never checked
+            Slot* fresh = new Slot[Slots];
+            if (m_slots.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel))
+                slots = fresh;
+            else
+                delete[] fresh;
+        }
+        Slot& slot = slots[key & (Slots - 1)];
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+    }
+
+private:
+    mutable std::atomic<Slot*> m_slots{nullptr};
+};
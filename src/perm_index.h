@@ -0,0 +1,83 @@
+#pragma once
+#include <mutex>
+#include <shared_mutex>
+
+#include <parallel_hashmap/phmap.h>
+#include <xxhash.h>
+#include <plg/vector.hpp>
+
+#include "basic.h"
+
+struct PermHolder
+{
+    uint64_t id; // user id, or hash of group name for groups
+    PermSource source; // UserTemp, User or Group
+    bool state; // indicates permission status (Allow/Disallow)
+};
+
+// Reverse index from permission line to everyone who defines it explicitly.
+// Keyed by hash of line segment ids ("*" included), kept up to date by PermTree on every add and delete.
+class PermIndex {
+    PermIndex() = default;
+    ~PermIndex() = default;
+
+public:
+    PermIndex(const PermIndex&) = delete;
+    static auto& Instance() {
+        static PermIndex instance;
+        return instance;
+    }
+
+    static uint64_t makeKey(const uint32_t ids[], const uint32_t sz)
+    {
+        return XXH3_64bits(ids, sz * sizeof(uint32_t));
+    }
+
+    // Insert holder or update its state
+    void add(const uint64_t key, const PermHolder& holder)
+    {
+        std::unique_lock lock(m_mutex);
+        plg::vector<PermHolder>& holders = m_holders[key];
+        for (PermHolder& h : holders)
+        {
+            if (h.id == holder.id && h.source == holder.source)
+            {
+                h.state = holder.state;
+                return;
+            }
+        }
+        holders.push_back(holder);
+    }
+
+    void remove(const uint64_t key, const uint64_t id, const PermSource source)
+    {
+        std::unique_lock lock(m_mutex);
+        const auto it = m_holders.find(key);
+        if (it == m_holders.end())
+            return;
+        plg::vector<PermHolder>& holders = it->second;
+        for (size_t i = 0; i < holders.size(); ++i)
+        {
+            if (holders[i].id == id && holders[i].source == source)
+            {
+                holders[i] = holders.back();
+                holders.pop_back();
+                break;
+            }
+        }
+        if (holders.empty())
+            m_holders.erase(it);
+    }
+
+    [[nodiscard]] plg::vector<PermHolder> find(const uint64_t key) const
+    {
+        std::shared_lock lock(m_mutex);
+        const auto it = m_holders.find(key);
+        return it == m_holders.end() ? plg::vector<PermHolder>() : it->second;
+    }
+
+private:
+    phmap::flat_hash_map<uint64_t, plg::vector<PermHolder>> m_holders;
+    mutable std::shared_mutex m_mutex;
+};
+inline PermIndex& g_PermIndex = PermIndex::Instance();
@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include <parallel_hashmap/phmap.h>
+#include <plg/string.hpp>
+#include <plg/vector.hpp>
+
+#include "segment_table.h"
+
+// Handle returned when permission line can't be registered
+constexpr uint32_t InvalidPermHandle = 0xFFFFFFFF;
+// Handles below this value are also bit indices in PermBits of every user and group
+constexpr uint32_t MaxIndexedPerms = 4096;
+
+struct RegisteredPerm
+{
+    plg::vector<uint32_t> ids; // segment ids of permission line
+    int user_sz; // number of segments checked in user trees (parsing stops after "*")
+    uint64_t hash; // hash of permission line, shared with string checks in result cache
+};
+
+// Pre-tokenized permission lines, registered once and addressed by handle afterwards.
+// Entries are never moved or removed, so readers access them without locking.
+class PermRegistry {
+    static constexpr uint32_t ChunkBits = 8;
+    static constexpr uint32_t ChunkSize = 1u << ChunkBits;
+    static constexpr uint32_t MaxChunks = 4096;
+
+    PermRegistry() = default;
+    ~PermRegistry() = default;
+
+public:
+    PermRegistry(const PermRegistry&) = delete;
+    static auto& Instance() {
+        static PermRegistry instance;
+        return instance;
+    }
+
+    uint32_t registerPerm(std::string_view perm, bool& inserted)
+    {
+        inserted = false;
+        if (perm.starts_with('-'))
+            perm = perm.substr(1);
+        if (perm.empty())
+            return InvalidPermHandle;
+
+        std::scoped_lock lock(m_mutex);
+        const auto it = m_handles.find(perm);
+        if (it != m_handles.end())
+            return it->second;
+
+        const uint32_t handle = m_size.load(std::memory_order_relaxed);
+        if (handle >= ChunkSize * MaxChunks)
+            return InvalidPermHandle;
+
+        auto& chunk = m_chunks[handle >> ChunkBits];
+        if (!chunk)
+            chunk = std::make_unique<RegisteredPerm[]>(ChunkSize);
+
+        RegisteredPerm& entry = chunk[handle & (ChunkSize - 1)];
+        entry.hash = XXH3_64bits(perm.data(), perm.size());
+        entry.user_sz = 0;
+        PermTokens tokens;
+        tokenize(perm, tokens, false);
+        for (const PermToken& token : tokens)
+        {
+            entry.ids.push_back(g_SegmentTable.intern(token.name()));
+            if (entry.user_sz == 0 && entry.ids.back() == AllAccess)
+                entry.user_sz = static_cast<int>(entry.ids.size());
+        }
+        if (entry.user_sz == 0)
+            entry.user_sz = static_cast<int>(entry.ids.size());
+
+        m_handles.try_emplace(plg::string(perm), handle);
+        m_size.store(handle + 1, std::memory_order_release);
+        inserted = true;
+        return handle;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const RegisteredPerm* get(const uint32_t handle) const
+    {
+        if (handle >= m_size.load(std::memory_order_acquire))
+            return nullptr;
+        return &m_chunks[handle >> ChunkBits][handle & (ChunkSize - 1)];
+    }
+
+    // Number of registered handles with a bit index
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t indexedCount() const
+    {
+        return std::min(m_size.load(std::memory_order_acquire), MaxIndexedPerms);
+    }
+
+private:
+    std::unique_ptr<RegisteredPerm[]> m_chunks[MaxChunks];
+    std::atomic<uint32_t> m_size{};
+    phmap::flat_hash_map<plg::string, uint32_t, string_hash, std::equal_to<>> m_handles;
+    std::mutex m_mutex;
+};
+inline PermRegistry& g_PermRegistry = PermRegistry::Instance();
@@ -0,0 +1,356 @@
+#pragma once
+#include "node.h"
+#include "perm_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <plg/vector.hpp>
+
+constexpr uint32_t SegmentNotFound = 0xFFFFFFFF;
+
+// Search nested node by segment id in sorted keys[first, first + count)
+PLUGIFY_FORCE_INLINE uint32_t findSegment(const uint32_t* keys, const uint32_t first, const uint32_t count,
+                                          const uint32_t id)
+{
+    constexpr uint32_t LinearSearchLimit = 8;
+    const uint32_t* begin = keys + first;
+    const uint32_t* end = begin + count;
+    if (count <= LinearSearchLimit)
+    {
+        for (const uint32_t* it = begin; it != end; ++it)
+            if (*it == id)
+                return first + static_cast<uint32_t>(it - begin);
+        return SegmentNotFound;
+    }
+    const uint32_t* it = std::lower_bound(begin, end, id);
+    if (it == end || *it != id)
+        return SegmentNotFound;
+    return first + static_cast<uint32_t>(it - begin);
+}
+
+// Index key of line ending at node with given path: path segments, then "*" for wildcard lines
+inline uint64_t lineKey(SegmentIds& path, const bool wildcard)
+{
+    if (!wildcard)
+        return PermIndex::makeKey(path.data(), path.size());
+    path.push_back(AllAccess);
+    const uint64_t key = PermIndex::makeKey(path.data(), path.size());
+    path.resize(path.size() - 1);
+    return key;
+}
+
+// Call fn(node, key) for every line defined in subtree of node, path holds segments of node
+template<typename N, typename F>
+void forEachLine(const N& node, SegmentIds& path, F&& fn)
+{
+    if (node.end_node)
+        fn(node, lineKey(path, node.wildcard));
+    node.nodes.forEach([&path, &fn](const uint32_t id, const N& child) {
+        path.push_back(id);
+        forEachLine(child, path, fn);
+        path.resize(path.size() - 1);
+    });
+}
+
+struct CompiledNode
+{
+    uint32_t first; // index of first nested node
+    uint32_t count; // number of nested nodes
+    time_t timestamp;
+    bool wildcard; // skip all nested nodes
+    bool state; // indicates permission status (Allow/Disallow)
+    bool end_node; // indicates non-intermediate node
+};
+
+// Read-only copy of a node tree packed into one contiguous arena.
+// Nodes are laid out in BFS order, so nested nodes of any node are stored next to each other
+// and sorted by segment id. keys[i] holds the segment id of nodes[i].
+struct CompiledTrie
+{
+    plg::vector<uint32_t> keys;
+    plg::vector<CompiledNode> nodes;
+    uint64_t content_id{}; // new for every build and never reused, copies keep it: equal ids mean equal contents
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t findChild(const CompiledNode& node, const uint32_t id) const
+    {
+        return findSegment(keys.data(), node.first, node.count, id);
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermission(const uint32_t ids[], const int sz, const bool exact,
+                                                             bool& w_wildcard, time_t& w_timestamp) const
+    {
+        w_wildcard = false;
+        const CompiledNode* root = nodes.data();
+        const bool l_wildcard = ids[sz - 1] == AllAccess;
+        const int counter = l_wildcard ? sz - 1 : sz;
+        if (sz == 1 && l_wildcard)
+        {
+            if (root->wildcard)
+            {
+                w_wildcard = true;
+                return root->state ? Status::Allow : Status::Disallow;
+            }
+            return Status::PermNotFound;
+        }
+        const CompiledNode* current = root;
+        const CompiledNode* lastWild = root->wildcard ? root : nullptr; // save last wildcard position
+
+        for (int i = 0; i < counter; ++i)
+        {
+            const uint32_t idx = findChild(*current, ids[i]);
+            if (idx == SegmentNotFound)
+            {
+                if (exact)
+                    return Status::PermNotFound;
+                // requested node not found - return wildcard status
+                w_wildcard = lastWild != nullptr;
+                return lastWild ? (lastWild->state ? Status::Allow : Status::Disallow) : Status::PermNotFound;
+            }
+
+            current = &nodes[idx];
+            if (current->wildcard) lastWild = current;
+        }
+
+        // Check non-intermediate node
+        if (current->end_node)
+        {
+            w_wildcard = current->wildcard;
+            w_timestamp = current->timestamp;
+            return current->state ? Status::Allow : Status::Disallow;
+        }
+
+        if (exact)
+            return Status::PermNotFound;
+        if (lastWild)
+        {
+            w_wildcard = true;
+            w_timestamp = lastWild->timestamp;
+            return lastWild->state ? Status::Allow : Status::Disallow;
+        }
+        return Status::PermNotFound;
+    }
+
+    // One counter for trees of all node types
+    [[nodiscard]] static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> last{};
+        return last.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    template<typename N>
+    void build(const N& root)
+    {
+        content_id = nextId();
+        keys.clear();
+        nodes.clear();
+        keys.push_back(0);
+        nodes.push_back({0, 0, root.timestamp, root.wildcard, root.state, root.end_node});
+
+        plg::vector<const N*> queue;
+        queue.push_back(&root);
+        plg::vector<std::pair<uint32_t, const N*>> children;
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            const N* cur = queue[i];
+            children.clear();
+            cur->nodes.forEach([&children](const uint32_t key, const N& val) { children.emplace_back(key, &val); });
+            std::ranges::sort(children, {}, &std::pair<uint32_t, const N*>::first);
+
+            nodes[i].first = static_cast<uint32_t>(nodes.size());
+            nodes[i].count = static_cast<uint32_t>(children.size());
+            for (const auto& [id, child] : children)
+            {
+                keys.push_back(id);
+                nodes.push_back({0, 0, child->timestamp, child->wildcard, child->state, child->end_node});
+                queue.push_back(child);
+            }
+        }
+    }
+};
+
+// Mutable Node tree paired with its compiled copy, which is used for all lookups
+// and rebuilt after every change of the tree. Trees with an owner also keep their lines in g_PermIndex.
+// Nodes are allocated from the tree's own arena, destroying the tree frees them in a few chunk releases.
+struct PermTree
+{
+    NodeArena arena; // memory of all nodes below root, declared first so move assignment releases it first
+    Node root;
+    CompiledTrie compiled;
+    uint32_t generation{}; // bumped on every rebuild of compiled trie
+    uint64_t owner_id{}; // user id, or hash of group name
+    PermSource owner_source{PermSource::NotFound}; // NotFound for trees not tracked in index
+
+    PermTree() : root{{}, 0xFFFFFFFF, false, false, true, 0}
+    {
+        compile();
+    }
+
+    // Deep copy into a new arena sized to fit, for a changed copy of the owner.
+    // Compiled trie and generation are copied as they are, both trees hold the same lines.
+    PermTree(const PermTree& other)
+        : compiled(other.compiled), generation(other.generation), owner_id(other.owner_id),
+          owner_source(other.owner_source)
+    {
+        if (other.arena.live() != 0)
+            arena.reserve(other.arena.live());
+        root.copyFrom(other.root, arena);
+    }
+
+    PermTree(PermTree&&) = default;
+    PermTree& operator=(PermTree&&) = default;
+
+    PLUGIFY_FORCE_INLINE void compile()
+    {
+        compiled.build(root);
+        ++generation;
+    }
+
+    // Move nodes to a fresh arena sized to fit them and release the old one at once.
+    // Costs a walk over the tree like compile, so changes run it only when much of arena is wasted,
+    // and before touching the tree, so the node returned by addPerm stays valid until the next change.
+    void compact()
+    {
+        NodeArena fresh;
+        fresh.reserve(arena.live());
+        root.nodes.relocate(fresh);
+        arena = std::move(fresh);
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermission(const uint32_t ids[], const int sz, const bool exact,
+                                                             bool& w_wildcard, time_t& w_timestamp) const
+    {
+        return compiled._hasPermission(ids, sz, exact, w_wildcard, w_timestamp);
+    }
+
+    PLUGIFY_FORCE_INLINE Node* addPerm(const std::string_view perm, const time_t timestamp = 0)
+    {
+        if (arena.sparse())
+            compact();
+        Node* node = addIndexed(perm);
+        node->timestamp = timestamp;
+        compile();
+        return node;
+    }
+
+    PLUGIFY_FORCE_INLINE void addPerms(const plg::vector<plg::string>& perms)
+    {
+        for (const plg::string& perm : perms)
+            addIndexed(perm);
+        compact();
+        compile();
+    }
+
+    PLUGIFY_FORCE_INLINE bool deletePerm(const std::string_view perm, const bool recursive_delete,
+                                         plg::vector<plg::string>& deleted_perms)
+    {
+        if (!erasePerm(perm, recursive_delete, deleted_perms))
+            return false;
+        recompile();
+        return true;
+    }
+
+    // deletePerm without compiling the tree, for several deletions in a row which end with recompile()
+    bool erasePerm(const std::string_view perm, const bool recursive_delete, plg::vector<plg::string>& deleted_perms)
+    {
+        // Collect index keys of lines which go away before the nodes are gone
+        plg::vector<uint64_t> keys;
+        if (owner_source != PermSource::NotFound)
+        {
+            SegmentIds path;
+            g_SegmentTable.lookup(perm.starts_with('-') ? perm.substr(1) : perm, path);
+            const bool hasWildcard = !path.empty() && path.back() == AllAccess;
+            if (hasWildcard)
+                path.resize(path.size() - 1);
+            if (const Node* target = find(path.data(), path.size()))
+            {
+                if (recursive_delete)
+                    forEachLine(*target, path, [&keys](const Node&, const uint64_t key) { keys.push_back(key); });
+                else
+                    keys.push_back(lineKey(path, hasWildcard));
+            }
+        }
+
+        if (!root.deletePerm(perm, recursive_delete, deleted_perms, arena))
+            return false;
+        for (const uint64_t key : keys)
+            g_PermIndex.remove(key, owner_id, owner_source);
+        return true;
+    }
+
+    void recompile()
+    {
+        if (arena.sparse())
+            compact();
+        compile();
+    }
+
+    // Node of line (without '-'), nullptr if the tree has no such line
+    [[nodiscard]] const Node* findLine(const std::string_view perm) const
+    {
+        SegmentIds path;
+        g_SegmentTable.lookup(perm, path);
+        const bool hasWildcard = !path.empty() && path.back() == AllAccess;
+        if (hasWildcard)
+            path.resize(path.size() - 1);
+        const Node* node = find(path.data(), path.size());
+        if (node == nullptr || !node->end_node || node->wildcard != hasWildcard)
+            return nullptr;
+        return node;
+    }
+
+    // Drop all lines of the tree from index, called before the owner is destroyed
+    void unindexAll() const
+    {
+        if (owner_source == PermSource::NotFound)
+            return;
+        SegmentIds path;
+        forEachLine(root, path, [this](const Node&, const uint64_t key) {
+            g_PermIndex.remove(key, owner_id, owner_source);
+        });
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE plg::vector<plg::string> dump(const bool preserve_state = true) const
+    {
+        return Node::dumpNode(root, preserve_state);
+    }
+
+private:
+    [[nodiscard]] const Node* find(const uint32_t ids[], const uint32_t sz) const
+    {
+        const Node* node = &root;
+        for (uint32_t i = 0; i < sz; ++i)
+        {
+            node = node->nodes.find(ids[i]);
+            if (node == nullptr)
+                return nullptr;
+        }
+        return node;
+    }
+
+    Node* addIndexed(const std::string_view perm)
+    {
+        if (owner_source == PermSource::NotFound)
+            return root.addPerm(perm, arena);
+
+        // Same path as Node::addPerm walks: '-' stripped from every segment, stop at "*"
+        PermTokens tokens;
+        tokenize(perm, tokens, false);
+        SegmentIds path;
+        for (const PermToken& token : tokens)
+        {
+            std::string_view ss = token.name();
+            if (ss.starts_with('-')) ss = ss.substr(1);
+            if (ss == "*")
+                break;
+            path.push_back(g_SegmentTable.intern(ss));
+        }
+
+        // "a" and "a.*" share one node, a new line replaces the other one
+        if (const Node* old = find(path.data(), path.size()); old && old->end_node)
+            g_PermIndex.remove(lineKey(path, old->wildcard), owner_id, owner_source);
+
+        Node* node = root.addPerm(perm, arena);
+        g_PermIndex.add(lineKey(path, node->wildcard), {owner_id, owner_source, node->state});
+        return node;
+    }
+};
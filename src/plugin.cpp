@@ -2,6 +2,7 @@
 #include <plg/plugin.hpp>
 #include <plg/string.hpp>
 #include <plugin_export.h>
+#include "event_queue.h"
 #include "timer_system.h"
 
 class PlugifyPermissions final : public plg::Plugin
@@ -22,6 +23,7 @@ public:
     plg::PluginResult OnPluginUpdate(std::chrono::milliseconds) override
     {
         g_TimerSystem.RunFrame();
+        g_EventQueue.drain();
 		return {};
     }
 } g_permissionsPlugin;
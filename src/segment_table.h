@@ -0,0 +1,93 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+
+#include <parallel_hashmap/phmap.h>
+#include <plg/string.hpp>
+
+#include "basic.h"
+#include "small_buffer.h"
+#include "tokenizer.h"
+
+// Identifier of the "*" segment, reserved on table creation
+constexpr uint32_t AllAccess = 0;
+// Identifier of a segment which was never interned, can't match any node
+constexpr uint32_t UnknownSegment = 0xFFFFFFFF;
+
+// Segment ids of one permission line
+using SegmentIds = SmallBuffer<uint32_t, 32>;
+
+// Global table of permission segments (dot-separated parts of permission lines).
+// Every segment is stored once and referenced by compact id from all user and group trees.
+// Segments are never removed, so ids stay valid for the whole lifetime of the core.
+class SegmentTable {
+    SegmentTable()
+    {
+        intern("*");
+    }
+    ~SegmentTable() = default;
+
+public:
+    SegmentTable(const SegmentTable&) = delete;
+    static auto& Instance() {
+        static SegmentTable instance;
+        return instance;
+    }
+
+    uint32_t intern(const std::string_view segment)
+    {
+        {
+            std::shared_lock lock(m_mutex);
+            const auto it = m_ids.find(segment);
+            if (it != m_ids.end())
+                return it->second;
+        }
+        std::unique_lock lock(m_mutex);
+        const auto [it, inserted] = m_ids.try_emplace(plg::string(segment), static_cast<uint32_t>(m_names.size()));
+        if (inserted)
+            m_names.push_back(it->first);
+        return it->second;
+    }
+
+    [[nodiscard]] uint32_t find(const std::string_view segment) const
+    {
+        std::shared_lock lock(m_mutex);
+        const auto it = m_ids.find(segment);
+        return it == m_ids.end() ? UnknownSegment : it->second;
+    }
+
+    // Split permission line by '.' and resolve every segment without interning new ones.
+    // Stops after "*" segment if stop_at_wildcard is set.
+    void lookup(const std::string_view perm, SegmentIds& ids, const bool stop_at_wildcard = true) const
+    {
+        PermTokens tokens;
+        tokenize(perm, tokens, stop_at_wildcard);
+        ids.clear();
+        resolve(tokens, ids);
+    }
+
+    // Resolve already tokenized segments and append their ids
+    void resolve(const PermTokens& tokens, SegmentIds& ids) const
+    {
+        std::shared_lock lock(m_mutex);
+        for (const PermToken& token : tokens)
+        {
+            const auto it = m_ids.find(token.name(), token.hash);
+            ids.push_back(it == m_ids.end() ? UnknownSegment : it->second);
+        }
+    }
+
+    [[nodiscard]] std::string_view name(const uint32_t id) const
+    {
+        std::shared_lock lock(m_mutex);
+        return m_names[id];
+    }
+
+private:
+    phmap::flat_hash_map<plg::string, uint32_t, string_hash, std::equal_to<>> m_ids;
+    std::deque<plg::string> m_names; // deque keeps stored strings in place on growth
+    mutable std::shared_mutex m_mutex;
+};
+inline SegmentTable& g_SegmentTable = SegmentTable::Instance();
@@ -0,0 +1,485 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include <parallel_hashmap/phmap.h>
+#include <xxhash.h>
+#include <plg/string.hpp>
+#include <plg/vector.hpp>
+
+#include "perm_tree.h"
+
+struct SharedNode;
+
+// Nested nodes of a shared node, sorted by segment id. Entries are stored in the same block right after the node.
+class SharedChildren {
+public:
+    struct Entry
+    {
+        uint32_t id;
+        const SharedNode* node;
+    };
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t size() const { return m_size; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool empty() const { return m_size == 0; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const Entry* begin() const { return m_data; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const Entry* end() const { return m_data + m_size; }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const SharedNode* find(const uint32_t id) const
+    {
+        const Entry* it = std::lower_bound(begin(), end(), id, [](const Entry& e, const uint32_t key) { return e.id < key; });
+        return it != end() && it->id == id ? it->node : nullptr;
+    }
+
+    // fn(id, child) for every nested node in order of segment id
+    template<typename F>
+    void forEach(F&& fn) const;
+
+private:
+    friend class NodePool;
+
+    Entry* m_data{};
+    uint32_t m_size{};
+};
+
+// Immutable trie node. Equal subtrees of all shared trees are stored once (hash-consed) and reference counted,
+// so a node is never changed in place: a change builds new copies of the nodes on its path.
+// Shared trees hold only permanent lines, so timestamp is always 0.
+struct SharedNode
+{
+    SharedChildren nodes; // nested nodes, keyed by segment id
+    uint64_t hash; // of flags and nested nodes, key in NodePool
+    mutable const SharedNode* next; // next node with the same hash
+    mutable uint32_t refs; // parent nodes and trees which reference the node
+    bool wildcard; // skip all nested nodes
+    bool state; // indicates permission status (Allow/Disallow)
+    bool end_node; // indicates non-intermediate node
+    static constexpr time_t timestamp = 0;
+};
+
+template<typename F>
+void SharedChildren::forEach(F&& fn) const
+{
+    for (const Entry& e : *this)
+        fn(e.id, *e.node);
+}
+
+// Store of all shared nodes and compiled tries of shared roots.
+// Trees of users from different shards change concurrently, so every call is made under mutex().
+// Lookups don't need it: nodes and compiled tries never change while a tree refers to them.
+class NodePool {
+    NodePool() = default;
+    ~NodePool() = default;
+
+public:
+    using Entry = SharedChildren::Entry;
+
+    NodePool(const NodePool&) = delete;
+    static auto& Instance() {
+        static NodePool instance;
+        return instance;
+    }
+
+    [[nodiscard]] std::mutex& mutex()
+    {
+        return m_mutex;
+    }
+
+    // Node with given flags and nested nodes (sorted by id), the caller owns one reference to it
+    const SharedNode* make(const bool wildcard, const bool state, const bool end_node, const Entry* nodes,
+                           const uint32_t count)
+    {
+        const uint64_t flags = static_cast<uint64_t>(wildcard) | static_cast<uint64_t>(state) << 1 |
+                               static_cast<uint64_t>(end_node) << 2;
+        uint64_t hash = XXH3_64bits_withSeed(&flags, sizeof(flags), count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint64_t part[2] = {nodes[i].id, reinterpret_cast<uintptr_t>(nodes[i].node)};
+            hash = XXH3_64bits_withSeed(part, sizeof(part), hash);
+        }
+
+        const SharedNode*& head = m_nodes[hash];
+        for (const SharedNode* node = head; node; node = node->next)
+        {
+            if (node->wildcard == wildcard && node->state == state && node->end_node == end_node &&
+                node->nodes.size() == count &&
+                std::equal(nodes, nodes + count, node->nodes.begin(), [](const Entry& a, const Entry& b) {
+                    return a.id == b.id && a.node == b.node;
+                }))
+            {
+                ++node->refs;
+                return node;
+            }
+        }
+
+        static_assert(alignof(Entry) <= alignof(SharedNode));
+        auto* node = new (::operator new(blockSize(count))) SharedNode{};
+        node->nodes.m_data = reinterpret_cast<Entry*>(node + 1);
+        node->nodes.m_size = count;
+        std::uninitialized_copy_n(nodes, count, node->nodes.m_data);
+        for (uint32_t i = 0; i < count; ++i)
+            ++nodes[i].node->refs;
+        node->hash = hash;
+        node->next = head;
+        node->refs = 1;
+        node->wildcard = wildcard;
+        node->state = state;
+        node->end_node = end_node;
+        head = node;
+        return node;
+    }
+
+    // Copy of node (or of an empty node) with other flags
+    const SharedNode* withFlags(const SharedNode* node, const bool wildcard, const bool state, const bool end_node)
+    {
+        return node ? make(wildcard, state, end_node, node->nodes.begin(), node->nodes.size())
+                    : make(wildcard, state, end_node, nullptr, 0);
+    }
+
+    // Copy of parent (or of an empty node) with nested node id replaced by child, removed if child is nullptr
+    const SharedNode* withChild(const SharedNode* parent, const uint32_t id, const SharedNode* child)
+    {
+        SmallBuffer<Entry, 16> nodes;
+        bool placed = child == nullptr;
+        if (parent)
+        {
+            for (const Entry& e : parent->nodes)
+            {
+                if (!placed && e.id >= id)
+                {
+                    nodes.push_back({id, child});
+                    placed = true;
+                }
+                if (e.id != id)
+                    nodes.push_back(e);
+            }
+        }
+        if (!placed)
+            nodes.push_back({id, child});
+        return parent ? make(parent->wildcard, parent->state, parent->end_node, nodes.data(), nodes.size())
+                      : make(false, false, false, nodes.data(), nodes.size());
+    }
+
+    // Take one more reference to node
+    const SharedNode* acquire(const SharedNode* node)
+    {
+        ++node->refs;
+        return node;
+    }
+
+    // Drop one reference, nodes which are no longer referenced are freed together with their unreferenced subtrees
+    void release(const SharedNode* node)
+    {
+        SmallBuffer<const SharedNode*, 16> dead;
+        if (--node->refs == 0)
+            dead.push_back(node);
+        while (!dead.empty())
+        {
+            node = dead.back();
+            dead.resize(dead.size() - 1);
+            for (const Entry& e : node->nodes)
+                if (--e.node->refs == 0)
+                    dead.push_back(e.node);
+
+            const auto it = m_nodes.find(node->hash);
+            if (it->second == node)
+            {
+                if (node->next)
+                    it->second = node->next;
+                else
+                    m_nodes.erase(it);
+            }
+            else
+            {
+                const SharedNode* prev = it->second;
+                while (prev->next != node)
+                    prev = prev->next;
+                prev->next = node->next;
+            }
+            ::operator delete(const_cast<SharedNode*>(node), blockSize(node->nodes.size()));
+        }
+    }
+
+    // Compiled trie of root, built once for all trees with this root
+    const CompiledTrie* acquireCompiled(const SharedNode* root)
+    {
+        auto& [trie, refs] = m_compiled[root];
+        if (refs++ == 0)
+            trie.build(*root);
+        return &trie;
+    }
+
+    void releaseCompiled(const SharedNode* root)
+    {
+        const auto it = m_compiled.find(root);
+        if (--it->second.second == 0)
+            m_compiled.erase(it);
+    }
+
+private:
+    [[nodiscard]] static size_t blockSize(const uint32_t count)
+    {
+        return sizeof(SharedNode) + count * sizeof(Entry);
+    }
+
+    phmap::flat_hash_map<uint64_t, const SharedNode*> m_nodes; // by hash, nodes with equal hash are chained
+    phmap::node_hash_map<const SharedNode*, std::pair<CompiledTrie, uint32_t>> m_compiled; // trie and tree count by root
+    std::mutex m_mutex;
+};
+inline NodePool& g_NodePool = NodePool::Instance();
+
+// Permanent permissions of a user. Users granted the same lines (same script, same defaults)
+// end up with the same root, sharing all nodes and the compiled trie used for lookups.
+// Same interface as PermTree for changes, lookups and dumps. Lines are kept in g_PermIndex when owner is set.
+struct SharedPermTree
+{
+    const SharedNode* root;
+    const CompiledTrie* compiled; // owned by g_NodePool, shared by trees with the same root
+    uint32_t generation{}; // bumped on every change of root
+    uint64_t owner_id{}; // user id
+    PermSource owner_source{PermSource::NotFound}; // NotFound for trees not tracked in index
+
+    SharedPermTree()
+    {
+        std::scoped_lock lock(g_NodePool.mutex());
+        root = g_NodePool.make(false, false, true, nullptr, 0);
+        compiled = g_NodePool.acquireCompiled(root);
+        ++generation;
+    }
+
+    // Another reference to the same nodes, for a changed copy of the owner
+    SharedPermTree(const SharedPermTree& other)
+        : generation(other.generation), owner_id(other.owner_id), owner_source(other.owner_source)
+    {
+        std::scoped_lock lock(g_NodePool.mutex());
+        root = g_NodePool.acquire(other.root);
+        compiled = g_NodePool.acquireCompiled(root);
+    }
+
+    SharedPermTree& operator=(const SharedPermTree&) = delete;
+
+    SharedPermTree(SharedPermTree&& other) noexcept
+        : root(std::exchange(other.root, nullptr)), compiled(std::exchange(other.compiled, nullptr)),
+          generation(other.generation), owner_id(other.owner_id), owner_source(other.owner_source)
+    {
+    }
+
+    SharedPermTree& operator=(SharedPermTree&& other) noexcept
+    {
+        if (this != &other)
+        {
+            {
+                std::scoped_lock lock(g_NodePool.mutex());
+                reset();
+            }
+            root = std::exchange(other.root, nullptr);
+            compiled = std::exchange(other.compiled, nullptr);
+            generation = other.generation;
+            owner_id = other.owner_id;
+            owner_source = other.owner_source;
+        }
+        return *this;
+    }
+
+    ~SharedPermTree()
+    {
+        if (root == nullptr)
+            return;
+        std::scoped_lock lock(g_NodePool.mutex());
+        reset();
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermission(const uint32_t ids[], const int sz, const bool exact,
+                                                             bool& w_wildcard, time_t& w_timestamp) const
+    {
+        return compiled->_hasPermission(ids, sz, exact, w_wildcard, w_timestamp);
+    }
+
+    void addPerm(const std::string_view perm)
+    {
+        const bool allow = !perm.starts_with('-');
+        bool hasWildcard = false;
+        // Same path as Node::addPerm walks: '-' stripped from every segment, stop at "*"
+        PermTokens tokens;
+        tokenize(perm, tokens, false);
+        SegmentIds path;
+        for (const PermToken& token : tokens)
+        {
+            std::string_view ss = token.name();
+            if (ss.starts_with('-')) ss = ss.substr(1);
+            if (ss == "*")
+            {
+                hasWildcard = true;
+                break;
+            }
+            path.push_back(g_SegmentTable.intern(ss));
+        }
+
+        // spine[d] - node reached after d segments, nullptr where path doesn't exist yet
+        SmallBuffer<const SharedNode*, 16> spine;
+        spine.push_back(root);
+        for (const uint32_t id : path)
+            spine.push_back(spine.back() ? spine.back()->nodes.find(id) : nullptr);
+
+        // "a" and "a.*" share one node, a new line replaces the other one
+        const SharedNode* old = spine.back();
+        if (owner_source != PermSource::NotFound && old && old->end_node)
+            g_PermIndex.remove(lineKey(path, old->wildcard), owner_id, owner_source);
+
+        {
+            std::scoped_lock lock(g_NodePool.mutex());
+            const SharedNode* node = g_NodePool.withFlags(old, hasWildcard, allow, true);
+            setRoot(copyPath(spine, path, path.size(), node));
+        }
+
+        if (owner_source != PermSource::NotFound)
+            g_PermIndex.add(lineKey(path, hasWildcard), {owner_id, owner_source, allow});
+    }
+
+    bool deletePerm(std::string_view perm, const bool recursive_delete, plg::vector<plg::string>& deleted_perms)
+    {
+        if (perm.starts_with('-'))
+            perm = perm.substr(1);
+        SegmentIds ids;
+        g_SegmentTable.lookup(perm, ids);
+        const uint32_t sz = ids.size();
+        if (sz < 1)
+            return false;
+
+        const bool hasWildcard = ids[sz - 1] == AllAccess;
+        const uint32_t depth = hasWildcard ? sz - 1 : sz; // segments before the line node
+        SmallBuffer<const SharedNode*, 16> spine;
+        spine.push_back(root);
+        for (uint32_t i = 0; i < depth; ++i)
+        {
+            const SharedNode* next = spine.back()->nodes.find(ids[i]);
+            if (next == nullptr)
+                return false;
+            spine.push_back(next);
+        }
+        const SharedNode* target = spine.back();
+        if (depth == 0 ? !target->wildcard : (!target->end_node || target->wildcard != hasWildcard))
+            return false; // Mark as "Not found"
+
+        // Collect index keys of lines which go away before the nodes are gone
+        plg::vector<uint64_t> keys;
+        if (owner_source != PermSource::NotFound)
+        {
+            SegmentIds path;
+            for (uint32_t i = 0; i < depth; ++i)
+                path.push_back(ids[i]);
+            if (recursive_delete)
+                forEachLine(*target, path, [&keys](const SharedNode&, const uint64_t key) { keys.push_back(key); });
+            else
+                keys.push_back(lineKey(path, hasWildcard));
+        }
+
+        std::scoped_lock lock(g_NodePool.mutex());
+        if (depth == 0)
+        {
+            if (recursive_delete)
+                deleted_perms = Node::dumpNode(*root, false);
+            else
+                deleted_perms.push_back("*");
+            setRoot(recursive_delete ? g_NodePool.make(false, false, false, nullptr, 0)
+                                     : g_NodePool.withFlags(root, false, false, false));
+        }
+        else
+        {
+            // Named exactly as Node::deletePerm names it, a one-segment line "a" comes out as "a.a"
+            plg::string base_name(g_SegmentTable.name(ids[0]));
+            for (uint32_t i = 1; i < sz - 1; ++i)
+            {
+                base_name += '.';
+                base_name += g_SegmentTable.name(ids[i]);
+            }
+            if (!hasWildcard)
+            {
+                base_name += '.';
+                base_name += g_SegmentTable.name(ids[sz - 1]);
+            }
+            if (recursive_delete)
+                Node::dumpNodes(base_name, *target, deleted_perms);
+            else
+            {
+                if (hasWildcard)
+                    base_name += ".*";
+                deleted_perms.push_back(base_name);
+            }
+
+            if (!recursive_delete && !target->nodes.empty())
+                setRoot(copyPath(spine, ids, depth, g_NodePool.withFlags(target, false, false, false)));
+            else
+            {
+                // Delete the line node and ancestors which are left without lines and nested nodes
+                uint32_t d = depth - 1;
+                while (d > 0 && !spine[d]->end_node && spine[d]->nodes.size() == 1)
+                    --d;
+                setRoot(copyPath(spine, ids, d, g_NodePool.withChild(spine[d], ids[d], nullptr)));
+            }
+        }
+
+        for (const uint64_t key : keys)
+            g_PermIndex.remove(key, owner_id, owner_source);
+        return true;
+    }
+
+    // Drop all lines of the tree from index, called before the owner is destroyed
+    void unindexAll() const
+    {
+        if (owner_source == PermSource::NotFound)
+            return;
+        SegmentIds path;
+        forEachLine(*root, path, [this](const SharedNode&, const uint64_t key) {
+            g_PermIndex.remove(key, owner_id, owner_source);
+        });
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE plg::vector<plg::string> dump(const bool preserve_state = true) const
+    {
+        return Node::dumpNode(*root, preserve_state);
+    }
+
+private:
+    // New root with node in place of spine[depth], copying spine[0, depth) on the way up. Takes over the reference to node.
+    static const SharedNode* copyPath(const SmallBuffer<const SharedNode*, 16>& spine, const SegmentIds& ids,
+                                      uint32_t depth, const SharedNode* node)
+    {
+        while (depth-- > 0)
+        {
+            const SharedNode* copy = g_NodePool.withChild(spine[depth], ids[depth], node);
+            g_NodePool.release(node);
+            node = copy;
+        }
+        return node;
+    }
+
+    // Takes over the reference to new_root, called under pool mutex
+    void setRoot(const SharedNode* new_root)
+    {
+        if (new_root == root)
+        {
+            g_NodePool.release(new_root);
+            return;
+        }
+        const CompiledTrie* new_compiled = g_NodePool.acquireCompiled(new_root);
+        reset();
+        root = new_root;
+        compiled = new_compiled;
+        ++generation;
+    }
+
+    void reset()
+    {
+        if (root == nullptr)
+            return;
+        g_NodePool.releaseCompiled(root);
+        g_NodePool.release(root);
+        root = nullptr;
+        compiled = nullptr;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include <plg/config.hpp>
+
+// Growable array which keeps first N elements inline (on stack for locals) and moves to heap only when they don't fit.
+// Meant for short-lived scratch buffers of trivially copyable values, e.g. segments of a permission line.
+template<typename T, uint32_t N>
+class SmallBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "SmallBuffer stores only trivially copyable types");
+
+public:
+    SmallBuffer() = default;
+    SmallBuffer(const SmallBuffer&) = delete;
+    SmallBuffer& operator=(const SmallBuffer&) = delete;
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE T* data() { return m_heap ? m_heap.get() : m_inline; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const T* data() const { return m_heap ? m_heap.get() : m_inline; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE uint32_t size() const { return m_size; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool empty() const { return m_size == 0; }
+
+    PLUGIFY_FORCE_INLINE T& operator[](const uint32_t i) { return data()[i]; }
+    PLUGIFY_FORCE_INLINE const T& operator[](const uint32_t i) const { return data()[i]; }
+    PLUGIFY_FORCE_INLINE T& back() { return data()[m_size - 1]; }
+
+    PLUGIFY_FORCE_INLINE T* begin() { return data(); }
+    PLUGIFY_FORCE_INLINE T* end() { return data() + m_size; }
+    PLUGIFY_FORCE_INLINE const T* begin() const { return data(); }
+    PLUGIFY_FORCE_INLINE const T* end() const { return data() + m_size; }
+
+    PLUGIFY_FORCE_INLINE void push_back(const T& value)
+    {
+        if (m_size == m_capacity)
+            grow();
+        data()[m_size++] = value;
+    }
+
+    // New elements are left uninitialized
+    PLUGIFY_FORCE_INLINE void resize(const uint32_t size)
+    {
+        while (m_capacity < size)
+            grow();
+        m_size = size;
+    }
+
+    PLUGIFY_FORCE_INLINE void clear() { m_size = 0; }
+
+private:
+    void grow()
+    {
+        const uint32_t capacity = m_capacity * 2;
+        auto heap = std::make_unique_for_overwrite<T[]>(capacity);
+        std::memcpy(heap.get(), data(), m_size * sizeof(T));
+        m_heap = std::move(heap);
+        m_capacity = capacity;
+    }
+
+    T m_inline[N];
+    std::unique_ptr<T[]> m_heap;
+    uint32_t m_size{};
+    uint32_t m_capacity{N};
+};
@@ -0,0 +1,239 @@
+#include "timer_queue.h"
+#include "timer_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <ctime>
+
+// Only the queue picked by PERMISSIONS_TIMER_WHEEL is built, timers carry its hook
+#if PERMISSIONS_TIMER_WHEEL
+
+static bool Before(const Timer* lhs, const Timer* rhs) {
+	return lhs->executeTime < rhs->executeTime ||
+	       (lhs->executeTime == rhs->executeTime && lhs->id < rhs->id);
+}
+
+// Order of due list: latest first
+static bool After(const Timer* lhs, const Timer* rhs) {
+	return Before(rhs, lhs);
+}
+
+// First whole second at which the timer is due
+static int64_t TickOf(const Timer& timer) {
+	return static_cast<int64_t>(std::ceil(timer.executeTime));
+}
+
+TimerWheel::TimerWheel() : m_now(static_cast<int64_t>(time(nullptr))) {
+}
+
+void TimerWheel::push(Timer& timer) {
+	if (TickOf(timer) <= m_now) {
+		const auto pos = std::upper_bound(m_due.begin(), m_due.end(), &timer, After) - m_due.begin();
+		m_due.push_back(&timer);
+		std::rotate(m_due.begin() + pos, m_due.end() - 1, m_due.end());
+		timer.hook.slot = Hook::Due;
+		return;
+	}
+
+	place(timer);
+}
+
+void TimerWheel::remove(Timer& timer) {
+	if (timer.hook.slot == Hook::Due) {
+		m_due.erase(std::lower_bound(m_due.begin(), m_due.end(), &timer, After));
+		timer.hook.slot = Hook::NotQueued;
+		return;
+	}
+
+	unlink(timer);
+}
+
+void TimerWheel::update(Timer& timer) {
+	remove(timer);
+	push(timer);
+}
+
+Timer* TimerWheel::popDue(double timestamp) {
+	const auto now = static_cast<int64_t>(std::floor(timestamp));
+
+	if (m_now < now) {
+		const size_t sorted = m_due.size();
+		while (m_now < now) {
+			// Nothing left to move, skip the remaining ticks at once
+			if (m_queued == 0) {
+				m_now = now;
+				break;
+			}
+			advance();
+		}
+		if (m_due.size() != sorted) {
+			std::sort(m_due.begin() + static_cast<ptrdiff_t>(sorted), m_due.end(), After);
+			std::inplace_merge(m_due.begin(), m_due.begin() + static_cast<ptrdiff_t>(sorted), m_due.end(), After);
+		}
+	}
+
+	// The clock may have gone back since timers became due
+	if (m_due.empty() || m_due.back()->executeTime > timestamp) {
+		return nullptr;
+	}
+
+	Timer* timer = m_due.back();
+	m_due.pop_back();
+	timer->hook.slot = Hook::NotQueued;
+	return timer;
+}
+
+// Link timer into the slot of the highest tier its tick differs from the current one in, tick must be in the future
+void TimerWheel::place(Timer& timer) {
+	const int64_t tick = TickOf(timer);
+	size_t tier = TierCount - 1;
+	while (tier > 0 && tick / TierTicks[tier] == m_now / TierTicks[tier]) {
+		--tier;
+	}
+	link(timer, TierOffset[tier] + static_cast<uint32_t>((tick / TierTicks[tier]) % TierSlots[tier]));
+}
+
+void TimerWheel::link(Timer& timer, uint32_t slot) {
+	Timer* head = m_slots[slot];
+	timer.hook.prev = nullptr;
+	timer.hook.next = head;
+	timer.hook.slot = slot;
+	if (head) {
+		head->hook.prev = &timer;
+	}
+	m_slots[slot] = &timer;
+	++m_queued;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+	Hook& hook = timer.hook;
+	if (hook.prev) {
+		hook.prev->hook.next = hook.next;
+	} else {
+		m_slots[hook.slot] = hook.next;
+	}
+	if (hook.next) {
+		hook.next->hook.prev = hook.prev;
+	}
+	hook = {};
+	--m_queued;
+}
+
+// Move to the next tick: cascade slots of every unit which just changed, from days down, then
+// take out timers of the new second. Due timers are appended unsorted, popDue() sorts them.
+void TimerWheel::advance() {
+	++m_now;
+	for (size_t tier = TierCount - 1; tier > 0; --tier) {
+		if (m_now % TierTicks[tier] == 0) {
+			cascade(TierOffset[tier] + static_cast<uint32_t>((m_now / TierTicks[tier]) % TierSlots[tier]));
+		}
+	}
+	cascade(static_cast<uint32_t>(m_now % TierSlots[0]));
+}
+
+void TimerWheel::cascade(uint32_t slot) {
+	Timer* timer = m_slots[slot];
+	m_slots[slot] = nullptr;
+	while (timer) {
+		Timer* next = timer->hook.next;
+		--m_queued;
+		if (TickOf(*timer) <= m_now) {
+			timer->hook = {};
+			timer->hook.slot = Hook::Due;
+			m_due.push_back(timer);
+		} else {
+			place(*timer);
+		}
+		timer = next;
+	}
+}
+
+#else
+
+void TimerHeap::push(Timer& timer) {
+	m_heap.push_back({timer.executeTime, timer.id, &timer});
+	timer.hook.index = m_heap.size() - 1;
+	siftUp(timer.hook.index);
+}
+
+void TimerHeap::remove(Timer& timer) {
+	removeAt(timer.hook.index);
+}
+
+void TimerHeap::update(Timer& timer) {
+	m_heap[timer.hook.index].executeTime = timer.executeTime;
+	fix(timer.hook.index);
+}
+
+Timer* TimerHeap::popDue(double timestamp) {
+	if (m_heap.empty() || m_heap.front().executeTime > timestamp) {
+		return nullptr;
+	}
+
+	Timer* timer = m_heap.front().timer;
+	removeAt(0);
+	return timer;
+}
+
+void TimerHeap::removeAt(size_t pos) {
+	m_heap[pos].timer->hook.index = Hook::NotQueued;
+	const Entry last = m_heap.back();
+	m_heap.pop_back();
+	if (pos < m_heap.size()) {
+		place(pos, last);
+		fix(pos);
+	}
+}
+
+// Restore heap order after the key at pos changed in either direction
+void TimerHeap::fix(size_t pos) {
+	if (pos > 0 && m_heap[pos] < m_heap[(pos - 1) / Arity]) {
+		siftUp(pos);
+	} else {
+		siftDown(pos);
+	}
+}
+
+void TimerHeap::siftUp(size_t pos) {
+	const Entry entry = m_heap[pos];
+	while (pos > 0) {
+		const size_t parent = (pos - 1) / Arity;
+		if (!(entry < m_heap[parent])) {
+			break;
+		}
+		place(pos, m_heap[parent]);
+		pos = parent;
+	}
+	place(pos, entry);
+}
+
+void TimerHeap::siftDown(size_t pos) {
+	const Entry entry = m_heap[pos];
+	const size_t size = m_heap.size();
+	while (true) {
+		const size_t first = pos * Arity + 1;
+		if (first >= size) {
+			break;
+		}
+		size_t best = first;
+		for (size_t child = first + 1; child < std::min(first + Arity, size); ++child) {
+			if (m_heap[child] < m_heap[best]) {
+				best = child;
+			}
+		}
+		if (!(m_heap[best] < entry)) {
+			break;
+		}
+		place(pos, m_heap[best]);
+		pos = best;
+	}
+	place(pos, entry);
+}
+
+void TimerHeap::place(size_t pos, const Entry& entry) {
+	m_heap[pos] = entry;
+	entry.timer->hook.index = pos;
+}
+
+#endif
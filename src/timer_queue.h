@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#include "plg/vector.hpp"
+
+struct Timer;
+
+// Queues of pending timers ordered by execute time, then by id. TimerSystem keeps the timers themselves,
+// a queue only links them through the Hook every timer carries. Both queues give timers out in the same order.
+
+// 4-ary min-heap: create, kill and reschedule in O(log n)
+class TimerHeap {
+public:
+    struct Hook {
+        static constexpr size_t NotQueued = std::numeric_limits<size_t>::max();
+
+        size_t index{NotQueued}; // position in heap
+    };
+
+    void push(Timer& timer);
+    void remove(Timer& timer);
+    void update(Timer& timer); // after execute time of a queued timer changed
+    Timer* popDue(double timestamp); // next timer with execute time <= timestamp, nullptr if none
+
+private:
+    // Keeps the order key next to the timer so sifting doesn't touch timers except to update their index
+    struct Entry {
+        double executeTime;
+        uint32_t id;
+        Timer* timer;
+
+        bool operator<(const Entry& other) const {
+            return executeTime < other.executeTime ||
+                   (executeTime == other.executeTime && id < other.id);
+        }
+    };
+
+    static constexpr size_t Arity = 4;
+
+    void removeAt(size_t pos);
+    void fix(size_t pos);
+    void siftUp(size_t pos);
+    void siftDown(size_t pos);
+    void place(size_t pos, const Entry& entry);
+
+    plg::vector<Entry> m_heap;
+};
+
+// Hierarchical timing wheel with one second ticks and tiers of seconds, minutes, hours and days:
+// create and kill in O(1), time advances in amortized O(1) per tick however far timers are.
+// A timer sits in the tier of the highest time unit its tick differs from the current one in,
+// and moves one tier down every time that unit of the current time changes. Days beyond the last
+// day slot wrap around and wait for another turn of the wheel. Due timers move to a list sorted
+// by execute time, so they run in the same order as from the heap.
+class TimerWheel {
+public:
+    struct Hook {
+        static constexpr uint32_t NotQueued = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t Due = NotQueued - 1;
+
+        Timer* prev{};
+        Timer* next{};
+        uint32_t slot{NotQueued}; // slot in wheel, Due in list of due timers
+    };
+
+    TimerWheel();
+
+    void push(Timer& timer);
+    void remove(Timer& timer);
+    void update(Timer& timer);
+    Timer* popDue(double timestamp);
+
+private:
+    static constexpr size_t TierCount = 4;
+    static constexpr std::array<int64_t, TierCount> TierSlots{60, 60, 24, 512};
+    static constexpr std::array<int64_t, TierCount> TierTicks{1, 60, 60 * 60, 24 * 60 * 60}; // seconds per slot
+    static constexpr std::array<uint32_t, TierCount> TierOffset{0, 60, 120, 144};
+    static constexpr size_t SlotCount = 144 + 512;
+
+    void place(Timer& timer);
+    void link(Timer& timer, uint32_t slot);
+    void unlink(Timer& timer);
+    void advance();
+    void cascade(uint32_t slot);
+
+    std::array<Timer*, SlotCount> m_slots{}; // heads of doubly linked lists
+    plg::vector<Timer*> m_due; // sorted by execute time descending, next one at the back
+    int64_t m_now; // last tick advanced to
+    size_t m_queued{}; // timers in wheel slots
+};
+
+#if PERMISSIONS_TIMER_WHEEL
+using TimerQueue = TimerWheel;
+#else
+using TimerQueue = TimerHeap;
+#endif
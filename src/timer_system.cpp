@@ -1,54 +1,67 @@
 #include "timer_system.h"
 
-void TimerSystem::RunFrame() {
-	std::scoped_lock lock(m_mutex);
+#include <algorithm>
 
+void TimerSystem::RunFrame() {
 	const auto timestamp = static_cast<double>(time(nullptr));
 
-	while (!m_timers.empty()) {
-		auto it = m_timers.begin();
+	// Take out every due timer at once, so callbacks can apply them in one pass
+	plg::vector<Batch> batches;
+	{
+		std::scoped_lock lock(m_mutex);
 
-		if (timestamp >= it->executeTime) {
-			it->exec = true;
-			it->callback(it->id, it->userData);
-			it->exec = false;
+		while (Timer* timer = m_queue.popDue(timestamp)) {
+			timer->exec = true;
 
-			if (it->repeat && !it->kill) {
-				auto node = m_timers.extract(it);
-				node.value().executeTime = timestamp + node.value().delay;
-				m_timers.insert(std::move(node));
-				continue;
+			auto it = std::ranges::find(batches, timer->callback, &Batch::callback);
+			if (it == batches.end()) {
+				batches.push_back({timer->callback, {}});
+				it = batches.end() - 1;
 			}
+			it->timers.push_back({timer->id, timer->data});
+		}
+	}
 
-			m_timers.erase(it);
-		} else {
-			break;
+	if (batches.empty()) {
+		return;
+	}
+
+	// Callbacks kill or reschedule timers they run, the lock is free so they may take their own locks first
+	for (const Batch& batch : batches) {
+		batch.callback(batch.timers, static_cast<time_t>(timestamp));
+	}
+
+	std::scoped_lock lock(m_mutex);
+
+	for (const Batch& batch : batches) {
+		for (const FiredTimer& fired : batch.timers) {
+			finish(fired.id, timestamp);
 		}
 	}
 }
 
-uint32_t TimerSystem::CreateTimer(double delay, TimerCallback callback, TimerFlag flags, const plg::vector<plg::any>& userData) {
+uint32_t TimerSystem::CreateTimer(double delay, TimerCallback callback, TimerFlag flags, const Expiration& data) {
 	std::scoped_lock lock(m_mutex);
 
 	const auto timestamp = static_cast<double>(time(nullptr));
 
 	// Enforce minimum delay to prevent immediate execution and iterator invalidation
 	uint32_t id = m_nextId++;
-	m_timers.emplace(id, flags & TimerFlag::Repeat, false, false, timestamp, timestamp + delay, delay, callback, userData);
+	auto [it, inserted] = m_timers.try_emplace(id, id, flags & TimerFlag::Repeat, false, false, timestamp, timestamp + delay, delay, callback, data);
+	m_queue.push(it->second);
 	return id;
 }
 
 void TimerSystem::KillTimer(uint32_t id) {
 	std::scoped_lock lock(m_mutex);
 
-	auto it = std::find_if(m_timers.begin(), m_timers.end(), [id](const Timer& timer) {
-		return timer.id == id;
-	});
+	auto it = m_timers.find(id);
 
 	if (it != m_timers.end()) {
-		if (it->exec) {
-			it->kill = true;
+		if (it->second.exec) {
+			it->second.kill = true;
 		} else {
+			m_queue.remove(it->second);
 			m_timers.erase(it);
 		}
 	}
@@ -57,16 +70,34 @@ void TimerSystem::KillTimer(uint32_t id) {
 void TimerSystem::RescheduleTimer(uint32_t id, double newDelay) {
 	std::scoped_lock lock(m_mutex);
 
-	auto it = std::find_if(m_timers.begin(), m_timers.end(), [id](const Timer& timer) {
-		return timer.id == id;
-	});
+	auto it = m_timers.find(id);
 
 	if (it != m_timers.end()) {
-		if (!it->exec) {
-			auto node = m_timers.extract(it);
-			node.value().delay = newDelay;
-			node.value().executeTime = static_cast<double>(time(nullptr)) + newDelay;
-			m_timers.insert(std::move(node));
+		Timer& timer = it->second;
+		timer.delay = newDelay;
+		timer.executeTime = static_cast<double>(time(nullptr)) + newDelay;
+		if (timer.exec) {
+			timer.rescheduled = true;
+		} else {
+			m_queue.update(timer);
+		}
+	}
+}
+
+// Queue a timer which has run again if it repeats or was rescheduled meanwhile, otherwise drop it
+void TimerSystem::finish(uint32_t id, double timestamp) {
+	auto it = m_timers.find(id);
+	Timer& timer = it->second;
+	timer.exec = false;
+
+	if (!timer.kill && (timer.repeat || timer.rescheduled)) {
+		if (!timer.rescheduled) {
+			timer.executeTime = timestamp + timer.delay;
 		}
+		timer.rescheduled = false;
+		m_queue.push(timer);
+		return;
 	}
+
+	m_timers.erase(it);
 }
\ No newline at end of file
@@ -1,34 +1,57 @@
 #pragma once
 #include <cstdint>
+#include <ctime>
 #include <mutex>
-#include <set>
 
-#include "plg/any.hpp"
+#include <parallel_hashmap/phmap.h>
+
 #include "plg/vector.hpp"
 
+#include "timer_queue.h"
+
 enum class TimerFlag {
     Default = 0,
 
     Repeat = (1 << 0)
 };
 
-using TimerCallback = void (*)(uint32_t, const plg::vector<plg::any>& userData);
+enum class ExpirationType : uint8_t {
+    Permission = 0,
+    Group = 1
+};
+
+// What expires when a timer fires: a temporary permission or a temporary group of a user.
+// Kept inline in the timer, so a timer needs no allocation besides its own entry.
+struct Expiration {
+    ExpirationType type{};
+    uint64_t targetID{}; // player ID of the user
+    uint64_t group{}; // key of temporary group in groups (hash of its name)
+    uint32_t perm{}; // temporary permission line without '-', interned in g_LineTable
+    bool state{}; // state of temporary permission
+};
+
+// Timer taken out of the queue to run, with a copy of its data
+struct FiredTimer {
+    uint32_t id;
+    Expiration data;
+};
+
+// Called once per frame with all timers of the callback due in that frame, in order of execute time.
+// Runs without any lock of the timer system held.
+using TimerCallback = void (*)(const plg::vector<FiredTimer>& timers, time_t timestamp);
 
 struct Timer {
     uint32_t id;
     bool repeat;
-    mutable bool exec;
-    mutable bool kill;
+    bool exec;
+    bool kill;
     double createTime;
     double executeTime;
     double delay;
     TimerCallback callback;
-    plg::vector<plg::any> userData;
-
-    bool operator<(const Timer& other) const {
-        return executeTime < other.executeTime ||
-               (executeTime == other.executeTime && id < other.id);
-    }
+    Expiration data;
+    bool rescheduled{}; // rescheduled while executing, queued again afterwards
+    TimerQueue::Hook hook{}; // place in m_queue, not queued while executing
 };
 
 class TimerSystem {
@@ -44,13 +67,24 @@ public:
 
     void RunFrame();
 
-    uint32_t CreateTimer(double delay, TimerCallback callback, TimerFlag flags = TimerFlag::Default, const plg::vector<plg::any>& userData = {});
+    uint32_t CreateTimer(double delay, TimerCallback callback, TimerFlag flags = TimerFlag::Default, const Expiration& data = {});
     void KillTimer(uint32_t id);
     void RescheduleTimer(uint32_t id, double newDelay);
 
 private:
-    std::set<Timer> m_timers;
-    std::recursive_mutex m_mutex;
+    // Due timers of one callback
+    struct Batch {
+        TimerCallback callback;
+        plg::vector<FiredTimer> timers;
+    };
+
+    void finish(uint32_t id, double timestamp);
+
+    // Timers by id, nodes keep their address for the queue which links them
+    phmap::node_hash_map<uint32_t, Timer> m_timers;
+    // Pending timers by execute time, a heap or a timing wheel depending on PERMISSIONS_TIMER_WHEEL
+    TimerQueue m_queue;
+    std::mutex m_mutex;
     uint32_t m_nextId{};
 };
 inline TimerSystem& g_TimerSystem = TimerSystem::Instance();
@@ -0,0 +1,85 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "basic.h"
+#include "small_buffer.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PERMISSIONS_TOKENIZER_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PERMISSIONS_TOKENIZER_SSE2 1
+#endif
+
+// Segment of a permission line together with its hash (same value as string_hash gives)
+struct PermToken
+{
+    const char* data;
+    uint32_t size;
+    size_t hash;
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE std::string_view name() const { return {data, size}; }
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool isWildcard() const { return size == 1 && *data == '*'; }
+};
+
+// Almost all permission lines fit inline, longer ones spill to heap
+using PermTokens = SmallBuffer<PermToken, 16>;
+
+// Call fn(pos) for every '.' in s[0, len) until it returns false. Returns false if stopped by fn.
+// Scans 32 (AVX2) or 16 (SSE2) bytes per step and walks the match mask, the rest is handled byte by byte.
+template<typename F>
+PLUGIFY_FORCE_INLINE bool forEachDot(const char* s, const size_t len, F&& fn)
+{
+    size_t i = 0;
+#if PERMISSIONS_TOKENIZER_AVX2
+    const __m256i dot32 = _mm256_set1_epi8('.');
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, dot32)));
+        for (; mask != 0; mask &= mask - 1)
+            if (!fn(i + static_cast<size_t>(std::countr_zero(mask))))
+                return false;
+    }
+#endif
+#if PERMISSIONS_TOKENIZER_SSE2
+    const __m128i dot16 = _mm_set1_epi8('.');
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, dot16)));
+        for (; mask != 0; mask &= mask - 1)
+            if (!fn(i + static_cast<size_t>(std::countr_zero(mask))))
+                return false;
+    }
+#endif
+    for (; i < len; ++i)
+        if (s[i] == '.' && !fn(i))
+            return false;
+    return true;
+}
+
+// Split permission line by '.' and hash every segment in the same pass.
+// Produces the same segments as std::views::split (empty line gives no segments),
+// stops after "*" segment if stop_at_wildcard is set.
+inline void tokenize(const std::string_view perm, PermTokens& tokens, const bool stop_at_wildcard = true)
+{
+    tokens.clear();
+    if (perm.empty())
+        return;
+
+    size_t start = 0;
+    const auto emit = [&](const size_t end) {
+        const std::string_view segment = perm.substr(start, end - start);
+        tokens.push_back({segment.data(), static_cast<uint32_t>(segment.size()), string_hash{}(segment)});
+        start = end + 1;
+        return !(stop_at_wildcard && tokens.back().isWildcard());
+    };
+    if (forEachDot(perm.data(), perm.size(), emit))
+        emit(perm.size());
+}
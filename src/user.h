@@ -1,5 +1,10 @@
 #pragma once
 #include "group.h"
+#include "effective_pool.h"
+#include "effective_trie.h"
+#include "shared_tree.h"
+
+#include <memory>
 
 #include <parallel_hashmap/phmap.h>
 #include <plg/any.hpp>
@@ -7,6 +12,9 @@
 #include <plg/vector.hpp>
 
 #include "group_manager.h"
+#include "line_table.h"
+#include "perm_cache.h"
+#include "perm_registry.h"
 #include "timer_system.h"
 
 struct User;
@@ -23,31 +31,26 @@ inline bool sortFF(const TempGroup& i, const TempGroup& j)
     return i.group->_priority > j.group->_priority;
 }
 
-enum class PermSource : uint32_t
-{
-    UserTemp = 0,
-    User = 1,
-    GroupTemp = 2,
-    Group = 3,
-    NotFound = 4,
-};
-
-void g_PermExpirationCallback(uint32_t, const plg::vector<plg::any>&);
-void g_GroupExpirationCallback(uint32_t, const plg::vector<plg::any>&);
+void g_ExpirationCallback(const plg::vector<FiredTimer>& timers, time_t timestamp);
 
-extern Group* GetGroup(const std::string_view& name);
+extern Group* FindGroup(const std::string_view& name);
 
 struct User
 {
-    Node user_nodes; // nodes of user
+    SharedPermTree user_nodes; // permanent nodes of user, shared with users granted the same lines
     // 1. Load from groups settings
     // 2. Load from players settings
-    Node temp_nodes;
+    PermTree temp_nodes;
 
     phmap::flat_hash_map<plg::string, plg::any, string_hash, std::equal_to<>> cookies;
     plg::vector<TempGroup> _groups; // groups that player belongs to
     int _immunity;
     bool _offline;
+    uint32_t _groups_generation{}; // bumped on every change of _groups
+    std::shared_ptr<const EffectiveTrie> _effective; // merged view of all permission sources, from g_EffectivePool
+    uint64_t _effective_stamp{}; // inputsStamp() _effective was picked for
+    uint64_t _groups_key{}; // hash of groups list if user has no own permissions, 0 otherwise
+    PermCache _cache; // results of recent permission checks
 
     [[nodiscard]] PLUGIFY_FORCE_INLINE int getImmunity() const
     {
@@ -56,82 +59,307 @@ struct User
         return _immunity;
     }
 
-    [[nodiscard]] Status hasPermission(std::string_view perm, PermSource& perm_type, const bool exact, bool& w_wildcard, time_t& w_timestamp) const
+    // Hash of everything the effective trie is built from: own trees, groups order and their parent chains
+    [[nodiscard]] uint64_t inputsStamp() const
     {
-        if (perm.starts_with('-'))
-            perm = perm.substr(1);
-        auto ispl = std::views::split(perm, '.');
-        uint64_t hashes[256];
-        std::string_view names[256];
-        int i = 0;
-        for (auto&& s : ispl)
+        EpochGuard guard;
+        return collect(nullptr);
+    }
+
+    // Hash inputs of effective trie and add them to sources if given, in order of lookup:
+    // temporary permissions, user permissions, then groups by priority (each with its parents)
+    uint64_t collect(plg::vector<EffectiveSource>* sources) const
+    {
+        uint64_t stamp = XXH3_64bits_withSeed(&temp_nodes.generation, sizeof(temp_nodes.generation), 0);
+        stamp = XXH3_64bits_withSeed(&user_nodes.generation, sizeof(user_nodes.generation), stamp);
+        stamp = XXH3_64bits_withSeed(&_groups_generation, sizeof(_groups_generation), stamp);
+        if (sources)
         {
-            // hashes[i] = calcHash(s);
-            hashes[i] = XXH3_64bits(s.data(), s.size());
-            names[i] = std::string_view(s);
-            ++i;
-            if (hashes[i - 1] == AllAccess)
-                break;
+            sources->push_back({&temp_nodes.compiled, PermSource::UserTemp, true});
+            sources->push_back({user_nodes.compiled, PermSource::User, true});
         }
+        for (const auto& tg : _groups)
+            stamp = tg.group->collect(stamp, sources, tg.timestamp == 0 ? PermSource::Group : PermSource::GroupTemp);
+        return stamp;
+    }
 
-        Status hasPerm = temp_nodes._hasPermission(names, hashes, i, exact, w_wildcard, w_timestamp);
-        if (hasPerm != Status::PermNotFound) // Check if user defined this permission temporarily
+    // Rebuild effective trie if any of its inputs changed. Must be called under exclusive lock, on a copy
+    // which is not published yet, after every change of user trees, user groups or permissions/hierarchy of groups.
+    // Groups are read as currently published, a group edited meanwhile refreshes the user again afterwards.
+    void refresh()
+    {
+        EpochGuard guard;
+        plg::vector<EffectiveSource> sources;
+        const uint64_t stamp = collect(&sources);
+        if (_effective && stamp == _effective_stamp)
+            return;
+
+        _effective = g_EffectivePool.acquire(sources);
+        _effective_stamp = stamp;
+
+        // Users without own permissions get the same result for any check as everyone with the same groups
+        _groups_key = 0;
+        if (temp_nodes.compiled.nodes.size() == 1 && !temp_nodes.root.wildcard &&
+            user_nodes.compiled->nodes.size() == 1 && !user_nodes.root->wildcard)
         {
-            perm_type = PermSource::UserTemp;
-            return hasPerm;
+            uint64_t key = 0;
+            for (const auto& tg : _groups)
+            {
+                const uint64_t part[2] = {reinterpret_cast<uintptr_t>(tg.group), tg.timestamp != 0};
+                key = XXH3_64bits_withSeed(part, sizeof(part), key);
+            }
+            _groups_key = key != 0 ? key : 1;
         }
+    }
 
-        hasPerm = user_nodes._hasPermission(names, hashes, i, exact, w_wildcard, w_timestamp);
-        if (hasPerm != Status::PermNotFound) // Check if user defined this permission
+    // Allow if every permission is allowed, Disallow if any is denied, PermNotFound otherwise.
+    // Indexed handles are tested a word at a time.
+    [[nodiscard]] Status hasAllPermissions(const plg::vector<uint32_t>& handles) const
+    {
+        const PermBits& bits = _effective->bits;
+        SmallBuffer<uint64_t, 8> mask;
+        mask.resize(static_cast<uint32_t>(bits.allow.size()));
+        std::fill(mask.begin(), mask.end(), 0);
+        bool all_allowed = true;
+        bool any_denied = false;
+        for (const uint32_t handle : handles)
         {
-            perm_type = PermSource::User;
-            return hasPerm;
+            if (bits.contains(handle))
+            {
+                mask[handle >> 6] |= 1ull << (handle & 63);
+                continue;
+            }
+            PermSource perm_type;
+            bool w_wildcard;
+            time_t w_timestamp;
+            const Status status = hasPermission(*g_PermRegistry.get(handle), perm_type, false, w_wildcard, w_timestamp);
+            all_allowed &= status == Status::Allow;
+            any_denied |= status == Status::Disallow;
         }
+        for (uint32_t w = 0; w < mask.size(); ++w)
+        {
+            all_allowed &= (bits.allow[w] & mask[w]) == mask[w];
+            any_denied |= (bits.deny[w] & mask[w]) != 0;
+        }
+        if (any_denied)
+            return Status::Disallow;
+        return all_allowed ? Status::Allow : Status::PermNotFound;
+    }
+
+    [[nodiscard]] Status hasPermission(std::string_view perm, PermSource& perm_type, const bool exact, bool& w_wildcard, time_t& w_timestamp) const
+    {
+        if (perm.starts_with('-'))
+            perm = perm.substr(1);
+        const uint64_t key = PermCache::makeKey(XXH3_64bits(perm.data(), perm.size()), exact, _effective->generation);
+        uint64_t data;
+        if (_cache.find(key, data))
+            return unpackResult(data, perm_type, w_wildcard, w_timestamp);
+
+        // Most lines are granted by groups or not at all, filter answers misses before resolving segments
+        PermTokens tokens;
+        tokenize(perm, tokens);
+        if (!_effective->filter.mayMatch(tokens))
+            return unpackResult(NotFoundResult, perm_type, w_wildcard, w_timestamp);
+
+        SegmentIds ids;
+        g_SegmentTable.resolve(tokens, ids);
+        return _hasPermissionCached(key, ids.data(), static_cast<int>(ids.size()), perm_type, exact, w_wildcard,
+                                    w_timestamp);
+    }
+
+    [[nodiscard]] Status hasPermission(const RegisteredPerm& perm, PermSource& perm_type, const bool exact, bool& w_wildcard, time_t& w_timestamp) const
+    {
+        const uint64_t key = PermCache::makeKey(perm.hash, exact, _effective->generation);
+        uint64_t data;
+        if (_cache.find(key, data))
+            return unpackResult(data, perm_type, w_wildcard, w_timestamp);
+
+        return _hasPermissionCached(key, perm.ids.data(), perm.user_sz, perm_type, exact, w_wildcard, w_timestamp);
+    }
 
-        for (const auto g : _groups)
+    // Check many permission lines at once. Leading segments shared with the previous line are neither parsed
+    // nor descended again, so lines grouped by prefix (menus, command trees) cost only their differing tails.
+    void hasPermissions(const plg::vector<plg::string>& perms, const bool exact, plg::vector<Status>& statuses) const
+    {
+        statuses.resize(perms.size());
+        std::string_view prev;
+        SegmentIds ids; // segments of previous line
+        SmallBuffer<uint32_t, 32> path; // path[d] - effective node reached after d segments of previous line
+        path.push_back(0);
+        PermTokens tokens;
+        for (size_t n = 0; n < perms.size(); ++n)
         {
-            hasPerm = g.group->_hasPermission(names, hashes, i, exact, w_wildcard);
-            if (hasPerm != Status::PermNotFound)
+            std::string_view perm = perms[n];
+            if (perm.empty())
+            {
+                statuses[n] = Status::Error;
+                continue;
+            }
+            if (perm.starts_with('-'))
+                perm = perm.substr(1);
+            if (perm.empty())
+            {
+                statuses[n] = Status::PermNotFound;
+                prev = perm;
+                ids.clear();
+                path.resize(1);
+                continue;
+            }
+
+            // Count complete leading segments equal to previous line
+            size_t m = 0;
+            const size_t limit = std::min(perm.size(), prev.size());
+            while (m < limit && perm[m] == prev[m])
+                ++m;
+            uint32_t shared = 0;
+            size_t offset = 0;
+            for (size_t i = 0; i < m; ++i)
             {
-                perm_type = g.timestamp == 0 ? PermSource::Group : PermSource::GroupTemp;
-                return hasPerm;
+                if (perm[i] == '.')
+                {
+                    ++shared;
+                    offset = i + 1;
+                }
+            }
+            bool parsed = false;
+            if (m == perm.size())
+            {
+                if (m == prev.size()) // same line
+                {
+                    shared = ids.size();
+                    parsed = true;
+                }
+                else if (prev[m] == '.') // line is a prefix of previous one
+                {
+                    ++shared;
+                    parsed = true;
+                }
             }
+            else if (m != 0 && m == prev.size() && perm[m] == '.') // previous line is a prefix of this one
+            {
+                ++shared;
+                offset = m + 1;
+            }
+            if (shared >= ids.size())
+            {
+                // Previous line was cut after "*" inside the shared part, so is this one
+                if (!ids.empty() && ids.back() == AllAccess)
+                    parsed = true;
+                shared = ids.size();
+            }
+
+            ids.resize(shared);
+            if (!parsed)
+            {
+                tokenize(perm.substr(offset), tokens);
+                if (offset == perm.size()) // trailing empty segment after '.'
+                    tokens.push_back({perm.data() + offset, 0, string_hash{}(std::string_view{})});
+                g_SegmentTable.resolve(tokens, ids);
+            }
+
+            uint64_t data = NotFoundResult;
+            const uint32_t sz = ids.size();
+            if (sz != 0)
+            {
+                const bool l_wildcard = ids[sz - 1] == AllAccess;
+                const uint32_t counter = l_wildcard ? sz - 1 : sz;
+                if (sz == 1 && l_wildcard)
+                    data = _effective->star;
+                else
+                {
+                    path.resize(std::min(path.size(), std::min(shared, counter) + 1));
+                    bool complete = true;
+                    while (path.size() - 1 < counter)
+                    {
+                        const uint32_t idx = _effective->child(path.back(), ids[path.size() - 1]);
+                        if (idx == SegmentNotFound)
+                        {
+                            complete = false;
+                            break;
+                        }
+                        path.push_back(idx);
+                    }
+                    data = _effective->result(path.back(), complete, exact);
+                }
+            }
+
+            PermSource perm_type;
+            bool w_wildcard;
+            time_t w_timestamp;
+            const Status status = unpackResult(data, perm_type, w_wildcard, w_timestamp);
+            statuses[n] = exact && isWildcard(perm) != w_wildcard ? Status::PermNotFound : status;
+            prev = perm;
         }
-        perm_type = PermSource::NotFound;
-        return Status::PermNotFound;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermissionCached(const uint64_t key, const uint32_t ids[], const int i,
+                                                                   PermSource& perm_type, const bool exact,
+                                                                   bool& w_wildcard, time_t& w_timestamp) const
+    {
+        time_t timestamp = -1;
+        const Status status = _hasPermission(ids, i, perm_type, exact, w_wildcard, timestamp);
+        _cache.store(key, packResult(status, perm_type, w_wildcard, timestamp));
+        if (timestamp != -1)
+            w_timestamp = timestamp;
+        return status;
+    }
+
+    // Temporary permissions first, then user permissions, then groups by priority (each with its parents)
+    [[nodiscard]] PLUGIFY_FORCE_INLINE Status _hasPermission(const uint32_t ids[], const int i, PermSource& perm_type,
+                                                             const bool exact, bool& w_wildcard,
+                                                             time_t& w_timestamp) const
+    {
+        return _effective->_hasPermission(ids, i, perm_type, exact, w_wildcard, w_timestamp);
     }
 
     PLUGIFY_FORCE_INLINE void addTempPerm(const std::string_view& perm, time_t timestamp, uint64_t user_id)
     {
-        Node* node = temp_nodes.addPerm(perm);
+        Node* node = temp_nodes.addPerm(perm, timestamp);
         if (node->timer == 0xFFFFFFFF)
+        {
+            const std::string_view line = perm.starts_with('-') ? perm.substr(1) : perm;
             node->timer = g_TimerSystem.CreateTimer(static_cast<double>(timestamp) - static_cast<double>(time(nullptr)),
-                                                    g_PermExpirationCallback, TimerFlag::Default,
-                                                    plg::vector<plg::any>{
-                                                        perm,
-                                                        node->state,
-                                                        user_id
+                                                    g_ExpirationCallback, TimerFlag::Default,
+                                                    Expiration{
+                                                        .type = ExpirationType::Permission,
+                                                        .targetID = user_id,
+                                                        .perm = g_LineTable.intern(line),
+                                                        .state = node->state
                                                     });
+        }
         else
             g_TimerSystem.RescheduleTimer(node->timer,
                                           static_cast<double>(timestamp) - static_cast<double>(time(nullptr)));
-        node->timestamp = timestamp;
     }
 
     PLUGIFY_FORCE_INLINE void addGroup(Group* g, time_t timestamp, uint64_t targetID)
     {
         TempGroup& tg = this->_groups.emplace_back(timestamp, g, 0xFFFFFFFF);
+        ++_groups_generation;
         if (timestamp != 0)
         {
             tg.timer = g_TimerSystem.CreateTimer(static_cast<double>(timestamp) - static_cast<double>(time(nullptr)),
-                                                 g_GroupExpirationCallback, TimerFlag::Default, plg::vector<plg::any>{
-                                                     g->_name,
-                                                     targetID
+                                                 g_ExpirationCallback, TimerFlag::Default, Expiration{
+                                                     .type = ExpirationType::Group,
+                                                     .targetID = targetID,
+                                                     .group = XXH3_64bits(g->_name.data(), g->_name.size())
                                                  });
         }
         this->sortGroups();
     }
 
+    // Group is in the list itself, not only as a parent of another one
+    [[nodiscard]] PLUGIFY_FORCE_INLINE bool hasGroup(const Group* g) const
+    {
+        return findGroup(g) != nullptr;
+    }
+
+    [[nodiscard]] PLUGIFY_FORCE_INLINE const TempGroup* findGroup(const Group* g) const
+    {
+        const auto it = std::ranges::find(_groups, g, &TempGroup::group);
+        return it == _groups.end() ? nullptr : &*it;
+    }
+
     PLUGIFY_FORCE_INLINE bool delGroup(const Group* g)
     {
         for (auto it = this->_groups.begin(); it != this->_groups.end(); ++it)
@@ -141,6 +369,7 @@ struct User
                 if (it->timestamp != 0)
                     g_TimerSystem.KillTimer(it->timer);
                 this->_groups.erase(it);
+                ++_groups_generation;
                 return true;
             }
         }
@@ -152,16 +381,20 @@ struct User
         std::ranges::sort(this->_groups, sortFF);
     }
 
+    // Caller holds groups_mtx
     User(const int immunity, const plg::vector<plg::string>& groupsList, const uint64_t user_id, bool offline)
     {
         this->_offline = offline;
         this->_immunity = immunity;
+        this->user_nodes.owner_id = this->temp_nodes.owner_id = user_id;
+        this->user_nodes.owner_source = PermSource::User;
+        this->temp_nodes.owner_source = PermSource::UserTemp;
         for (const plg::string& s : groupsList)
         {
             std::string_view group_view;
             time_t timestamp = 0;
             parseTempString(s, group_view, timestamp);
-            Group* g = GetGroup(group_view);
+            Group* g = FindGroup(group_view);
             // Skip missed or already defined groups
             if (g == nullptr || timestamp != 0)
                 continue;
@@ -188,7 +421,7 @@ struct User
             std::string_view group_view;
             time_t timestamp = 0;
             parseTempString(s, group_view, timestamp);
-            Group* g = GetGroup(group_view);
+            Group* g = FindGroup(group_view);
             // Skip missed or already defined groups
             if (g == nullptr || timestamp == 0)
                 continue;
@@ -211,10 +444,6 @@ struct User
                 addGroup(g, timestamp, user_id);
         }
         sortGroups();
-        this->user_nodes = {phmap::flat_hash_map<plg::string, Node, string_hash>(), 0xFFFFFFFF, false, false, true, 0};
-        this->temp_nodes = {phmap::flat_hash_map<plg::string, Node, string_hash>(), 0xFFFFFFFF, false, false, true, 0};
-
-        Node::forceRehash(this->user_nodes.nodes);
-        Node::forceRehash(this->temp_nodes.nodes);
+        refresh();
     }
 };
@@ -1,21 +1,45 @@
 #pragma once
 #include "basic.h"
+#include "callback_registry.h"
+#include "event_queue.h"
 #include "group.h"
 #include "user.h"
+#include "user_map.h"
 #include "group_manager.h"
+#include "perm_registry.h"
 
 #include <plg/any.hpp>
 #include <plugin_export.h>
 #include <set>
 
-extern phmap::flat_hash_map<uint64_t, User> users;
+extern UserMap users;
 
+// Rebuild effective permissions of users affected by a change in groups, must be called after the changed
+// group versions are published. Shards are locked one at a time: a user changed meanwhile in a shard which
+// is not visited yet is already built from the new versions, and is skipped here.
+// Only users whose inputs changed get a new version.
+inline void RefreshUsers()
+{
+    users.forEachLocked([](const uint64_t id, const User& value) {
+        if (value.inputsStamp() == value._effective_stamp)
+            return;
+        auto* user = new User(value);
+        user->refresh();
+        users.publish(id, user);
+    });
+}
+
+// Delete group from all users, and rebuild users which inherited it through another group
 inline void GroupManager_Callback(const Group* group)
 {
-    // Delete group from all users
-    std::unique_lock lock(users_mtx);
-    for (auto& value : users | std::views::values)
-        value.delGroup(group);
+    users.forEachLocked([group](const uint64_t id, const User& value) {
+        if (!value.hasGroup(group) && value.inputsStamp() == value._effective_stamp)
+            return;
+        auto* user = new User(value);
+        user->delGroup(group);
+        user->refresh();
+        users.publish(id, user);
+    });
 }
 
 enum class PlayerState : uint32_t {
@@ -133,65 +157,38 @@ using UserLoadedCallback = void(*)(const int64_t pluginID, const uint64_t target
  */
 using UserRequestCallback = void(*)(const int64_t pluginID, const uint64_t targetID, const plg::string& username, const bool offline, UserLoadedCallback callback);
 
-struct UserPermissionCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserPermissionCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserSetCookieCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserSetCookieCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserGroupCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserGroupCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserCreateCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserCreateCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserDeleteCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserDeleteCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct PermExpirationCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<PermExpirationCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct GroupExpirationCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<GroupExpirationCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserLoadCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserRequestCallback> _callbacks;
-    std::atomic_int _counter;
-};
-
-struct UserLoadedCallbacks
-{
-    std::shared_mutex _lock;
-    phmap::flat_hash_set<UserLoadedCallback> _callbacks;
-    std::atomic_int _counter;
-};
+/**
+ * @brief Callback invoked once per plugin update with all permission and group changes made since the previous one.
+ *
+ * Changes are passed as parallel arrays in the order they were made: change i consists of element i of every array.
+ * Gets the same changes as UserPermission, GroupPermission and UserGroup listeners, and expirations of temporary
+ * permissions and groups as their removals, so storage extensions can subscribe to it instead and write
+ * the changes of one update at once.
+ *
+ * @param pluginIDs      Identifiers of the plugins that initiated the changes (0 for expirations).
+ * @param kinds          What changed: permission of user, permission of group or group of user.
+ * @param actions        Actions performed.
+ * @param targetIDs      Player IDs of the affected users (0 for permissions of groups).
+ * @param groupNames     Names of the affected groups (empty for permissions of users).
+ * @param perms          Permission lines affected (empty for groups of users).
+ * @param oldStates      States before the changes (PermNotFound for groups of users).
+ * @param newStates      States after the changes (PermNotFound for groups of users).
+ * @param oldTimestamps  Durations before the changes (-1 if it didn't exist, 0 for permissions of groups).
+ * @param newTimestamps  New durations (0 for permissions of groups).
+ */
+using ChangeBatchCallback = void (*)(const plg::vector<int64_t>& pluginIDs, const plg::vector<ChangeKind>& kinds,
+                                     const plg::vector<Action>& actions, const plg::vector<uint64_t>& targetIDs,
+                                     const plg::vector<plg::string>& groupNames, const plg::vector<plg::string>& perms,
+                                     const plg::vector<Status>& oldStates, const plg::vector<Status>& newStates,
+                                     const plg::vector<int64_t>& oldTimestamps, const plg::vector<int64_t>& newTimestamps);
+
+using UserPermissionCallbacks = CallbackRegistry<UserPermissionCallback>;
+using UserSetCookieCallbacks = CallbackRegistry<UserSetCookieCallback>;
+using UserGroupCallbacks = CallbackRegistry<UserGroupCallback>;
+using UserCreateCallbacks = CallbackRegistry<UserCreateCallback>;
+using UserDeleteCallbacks = CallbackRegistry<UserDeleteCallback>;
+using PermExpirationCallbacks = CallbackRegistry<PermExpirationCallback>;
+using GroupExpirationCallbacks = CallbackRegistry<GroupExpirationCallback>;
+using UserLoadCallbacks = CallbackRegistry<UserRequestCallback>;
+using UserLoadedCallbacks = CallbackRegistry<UserLoadedCallback>;
+using ChangeBatchCallbacks = CallbackRegistry<ChangeBatchCallback>;
@@ -0,0 +1,265 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <xxhash.h>
+
+#include "user.h"
+#include "epoch.h"
+
+// Users by id, looked up without locks. Readers call find() and forEach() inside an EpochGuard and get
+// an immutable version of the user which stays valid until the guard ends. Writers never change a published
+// user: they publish a changed copy, and the old one is destroyed after readers leave.
+// Users are split into shards by id hash. A change of one user locks only its shard (lock()), so writers
+// of different users don't wait for each other; changes which touch every user visit the shards one by one
+// (forEachLocked()), so they never stop all writers at once.
+// Every shard is a table with open addressing and linear probing. A slot keeps its id once taken,
+// deleted users leave the slot empty until the table is rebuilt on growth.
+class UserMap {
+    static constexpr size_t ShardBits = 4;
+    static constexpr size_t ShardCount = size_t{1} << ShardBits;
+    static constexpr size_t MinCapacity = 16;
+
+    struct Slot
+    {
+        std::atomic<User*> user{}; // published version, nullptr if deleted
+        uint64_t id{}; // set before taken is published, never changed afterwards
+        std::atomic<bool> taken{};
+    };
+
+    struct Table
+    {
+        explicit Table(const size_t capacity) : slots(std::make_unique<Slot[]>(capacity)), mask(capacity - 1) {}
+
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+        size_t taken{}; // slots with an id, deleted ones included
+    };
+
+    struct alignas(64) Shard
+    {
+        std::atomic<Table*> table{new Table(MinCapacity)};
+        std::atomic<size_t> size{};
+        std::mutex mutex; // held by writers of users in this shard
+    };
+
+public:
+    UserMap() = default;
+    UserMap(const UserMap&) = delete;
+    UserMap& operator=(const UserMap&) = delete;
+
+    ~UserMap()
+    {
+        for (Shard& shard : m_shards)
+        {
+            const Table* table = shard.table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= table->mask; ++i)
+                delete table->slots[i].user.load(std::memory_order_relaxed);
+            delete table;
+        }
+        g_Epoch.collect();
+    }
+
+    // Lock shard of user for a change of that user, or for its insert or erase
+    [[nodiscard]] std::unique_lock<std::mutex> lock(const uint64_t id)
+    {
+        return std::unique_lock(shard(hash(id)).mutex);
+    }
+
+    // Published version of user, nullptr if not found
+    [[nodiscard]] const User* find(const uint64_t id) const
+    {
+        const uint64_t h = hash(id);
+        const Slot* slot = lookup(*shard(h).table.load(std::memory_order_acquire), id, h);
+        return slot ? slot->user.load(std::memory_order_acquire) : nullptr;
+    }
+
+    // Version of user for a read. Same as find(), except that listeners of a user's deletion still see
+    // the deleted user on the thread which runs them (DepartedScope), unless a new one took its id.
+    // Writers use find(), so they never change a deleted user.
+    [[nodiscard]] const User* view(const uint64_t id) const
+    {
+        if (const User* user = find(id))
+            return user;
+        const Departed& d = departed();
+        return d.user != nullptr && d.id == id ? d.user : nullptr;
+    }
+
+    // Makes a user erased from the map visible to view() on this thread for the lifetime of the scope
+    class DepartedScope {
+    public:
+        DepartedScope(const uint64_t id, const User* user) { departed() = {id, user}; }
+        ~DepartedScope() { departed() = {}; }
+        DepartedScope(const DepartedScope&) = delete;
+        DepartedScope& operator=(const DepartedScope&) = delete;
+    };
+
+    [[nodiscard]] bool contains(const uint64_t id) const
+    {
+        return find(id) != nullptr;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        size_t size = 0;
+        for (const Shard& shard : m_shards)
+            size += shard.size.load(std::memory_order_relaxed);
+        return size;
+    }
+
+    // fn(id, user) for every user, in no particular order
+    template<typename F>
+    void forEach(F&& fn) const
+    {
+        for (const Shard& shard : m_shards)
+        {
+            const Table* table = shard.table.load(std::memory_order_acquire);
+            for (size_t i = 0; i <= table->mask; ++i)
+            {
+                const Slot& slot = table->slots[i];
+                if (!slot.taken.load(std::memory_order_acquire))
+                    continue;
+                if (const User* user = slot.user.load(std::memory_order_acquire))
+                    fn(slot.id, *user);
+            }
+        }
+    }
+
+    // fn(id, user) for every user, locking one shard at a time, so fn may publish changed copies.
+    // Writers of other shards go on meanwhile. Must not be called with any shard locked.
+    template<typename F>
+    void forEachLocked(F&& fn)
+    {
+        for (Shard& shard : m_shards)
+        {
+            std::scoped_lock lock(shard.mutex);
+            const Table* table = shard.table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= table->mask; ++i)
+            {
+                const Slot& slot = table->slots[i];
+                if (!slot.taken.load(std::memory_order_relaxed))
+                    continue;
+                if (const User* user = slot.user.load(std::memory_order_relaxed))
+                    fn(slot.id, *user);
+            }
+        }
+    }
+
+    // Add a user which is not in the map, shard of user must be locked
+    void insert(const uint64_t id, User* user)
+    {
+        const uint64_t h = hash(id);
+        Shard& s = shard(h);
+        Table* table = s.table.load(std::memory_order_relaxed);
+        if (Slot* slot = lookup(*table, id, h))
+            slot->user.store(user, std::memory_order_release);
+        else
+        {
+            if ((table->taken + 1) * 4 > (table->mask + 1) * 3)
+                table = grow(s);
+            place(*table, id, h, user);
+        }
+        s.size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Replace published version of user with a changed copy, the old version is retired.
+    // Shard of user must be locked.
+    void publish(const uint64_t id, User* user)
+    {
+        const uint64_t h = hash(id);
+        Slot* slot = lookup(*shard(h).table.load(std::memory_order_relaxed), id, h);
+        g_Epoch.retire(slot->user.exchange(user, std::memory_order_acq_rel));
+        g_Epoch.collectBatch();
+    }
+
+    // Remove user from map and hand it over to the caller, which retires it once done with it.
+    // Shard of user must be locked.
+    [[nodiscard]] User* erase(const uint64_t id)
+    {
+        const uint64_t h = hash(id);
+        Shard& s = shard(h);
+        Slot* slot = lookup(*s.table.load(std::memory_order_relaxed), id, h);
+        s.size.fetch_sub(1, std::memory_order_relaxed);
+        return slot->user.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+private:
+    struct Departed
+    {
+        uint64_t id{};
+        const User* user{};
+    };
+
+    [[nodiscard]] static Departed& departed()
+    {
+        thread_local Departed d;
+        return d;
+    }
+
+    [[nodiscard]] static uint64_t hash(const uint64_t id)
+    {
+        return XXH3_64bits(&id, sizeof(id));
+    }
+
+    // Top bits pick the shard, low bits the home slot inside its table
+    [[nodiscard]] Shard& shard(const uint64_t h)
+    {
+        return m_shards[h >> (64 - ShardBits)];
+    }
+
+    [[nodiscard]] const Shard& shard(const uint64_t h) const
+    {
+        return m_shards[h >> (64 - ShardBits)];
+    }
+
+    [[nodiscard]] static Slot* lookup(const Table& table, const uint64_t id, const uint64_t h)
+    {
+        for (size_t i = h & table.mask;; i = (i + 1) & table.mask)
+        {
+            Slot& slot = table.slots[i];
+            if (!slot.taken.load(std::memory_order_acquire))
+                return nullptr;
+            if (slot.id == id)
+                return &slot;
+        }
+    }
+
+    static void place(Table& table, const uint64_t id, const uint64_t h, User* user)
+    {
+        size_t i = h & table.mask;
+        while (table.slots[i].taken.load(std::memory_order_relaxed))
+            i = (i + 1) & table.mask;
+        Slot& slot = table.slots[i];
+        slot.id = id;
+        slot.user.store(user, std::memory_order_relaxed);
+        slot.taken.store(true, std::memory_order_release);
+        ++table.taken;
+    }
+
+    // Move live users of shard to a table with room for twice their number (the one being inserted included),
+    // readers of the old table finish on it
+    static Table* grow(Shard& shard)
+    {
+        Table* old = shard.table.load(std::memory_order_relaxed);
+        const size_t live = shard.size.load(std::memory_order_relaxed) + 1;
+        auto* table = new Table(std::bit_ceil(std::max(MinCapacity, live * 2)));
+        for (size_t i = 0; i <= old->mask; ++i)
+        {
+            const Slot& slot = old->slots[i];
+            if (!slot.taken.load(std::memory_order_relaxed))
+                continue;
+            if (User* user = slot.user.load(std::memory_order_relaxed))
+                place(*table, slot.id, hash(slot.id), user);
+        }
+        shard.table.store(table, std::memory_order_release);
+        g_Epoch.retire(old);
+        return table;
+    }
+
+    std::array<Shard, ShardCount> m_shards;
+};